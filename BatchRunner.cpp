@@ -0,0 +1,165 @@
+//==========================================================================
+// Name        : BatchRunner.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Prices many independent feed files concurrently
+//==========================================================================
+
+#include <chrono>
+#include <cstdlib>  // atol
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+
+#include "BatchRunner.h"
+#include "DecompressingReader.h"
+#include "Exceptions.h"
+#include "Log.h"
+#include "OrderBook.h"
+#include "PricingSession.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+
+namespace {
+
+double secondsSince(const std::chrono::steady_clock::time_point& start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Lines of a plain file read up front, or of a compressed one as they are decompressed
+class FeedLines {
+public:
+	explicit FeedLines(const std::string& filename) : next_(0) {
+		if (trading::DecompressingReader::detect(filename) == trading::DecompressingReader::plain) {
+			lines_ = trading::readFile2Vector(filename);
+		} else {
+			reader_.reset(new trading::DecompressingReader(filename));
+		}
+	}
+
+	bool getline(std::string& line) {
+		if (reader_) {
+			return reader_->getline(line);
+		}
+		if (next_ == lines_.size()) {
+			return false;
+		}
+		line.swap(lines_[next_++]);
+		return true;
+	}
+
+	bool good() const { return !reader_ || reader_->good(); }
+
+private:
+	std::vector<std::string> lines_;
+	std::size_t next_;
+	std::unique_ptr<trading::DecompressingReader> reader_;
+};
+
+} // end of anonymous namespace
+
+trading::BatchRunner::BatchRunner(const MarketOrder::Size& targetSize, bool conflate, std::size_t threads)
+	: targetSize_(targetSize), conflate_(conflate), threads_(threads), seconds_(0) {
+}
+
+void trading::BatchRunner::add(const std::string& filename) {
+	Result result;
+	result.filename = filename;
+	result.opened = false;
+	result.messages = 0;
+	result.skipped = 0;
+	result.seconds = 0;
+	results_.push_back(result);
+}
+
+void trading::BatchRunner::run() {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		ThreadPool pool(threads_);
+		for (std::size_t i = 0; i < results_.size(); i++) {
+			pool.submit(std::bind(&BatchRunner::price, this, std::ref(results_[i])));
+		}
+		pool.wait();
+	}
+	seconds_ = secondsSince(start);
+}
+
+void trading::BatchRunner::price(Result& result) const {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::unique_ptr<FeedLines> lines;
+	try {
+		lines.reset(new FeedLines(result.filename));
+	} catch (const BadMarketDataFile&) {
+		FILE_LOG(logERROR) << "Error opening the market data file " << result.filename;
+		return;
+	}
+	result.opened = true;
+
+	OrderBook book;
+	std::ostringstream out;
+	PricingSession session(book, targetSize_, out);
+
+	// One line of lookahead, for conflation
+	std::string msg;
+	std::string next;
+	unsigned long int messages = 0;
+	bool more = lines->getline(next);
+	while (more) {
+		msg.swap(next);
+		more = lines->getline(next);
+		session.apply(msg);
+		messages++;
+
+		if (!session.repriceDue()) {
+			continue;
+		}
+
+		// In conflation mode, keep applying while the next message has the same timestamp
+		if (conflate_ && more && static_cast<unsigned long int>(std::atol(next.c_str())) == session.lastTimestamp()) {
+			continue;
+		}
+
+		session.reprice();
+	}
+	if (!lines->good()) {
+		FILE_LOG(logERROR) << "The market data file " << result.filename << " is corrupt or truncated";
+	}
+
+	result.output = out.str();
+	result.errors = session.errorSummary();
+	result.messages = messages;
+	result.skipped = session.counters().errors();
+	result.seconds = secondsSince(start);
+}
+
+void trading::BatchRunner::report(std::ostream& out, std::ostream& stats) const {
+	unsigned long int messages = 0;
+	double jobSeconds = 0;
+
+	stats << std::setiosflags(std::ios::fixed) << std::setprecision(3);
+	for (std::size_t i = 0; i < results_.size(); i++) {
+		const Result& result = results_[i];
+		out << "# " << result.filename << std::endl;
+		out << result.output;
+
+		if (!result.opened) {
+			stats << result.filename << ": could not be read" << std::endl;
+			continue;
+		}
+		messages += result.messages;
+		jobSeconds += result.seconds;
+		stats << result.filename << ": " << result.messages << " messages (" << result.skipped << " skipped) in " <<
+				result.seconds << " s, " << std::setprecision(0) <<
+				(result.seconds > 0 ? result.messages / result.seconds : 0) << " msg/s" << std::setprecision(3) << std::endl;
+		if (!result.errors.empty()) {
+			stats << result.filename << ": " << result.errors << std::endl;
+		}
+	}
+
+	stats << "Total: " << results_.size() << " feeds, " << messages << " messages in " << seconds_ << " s on " <<
+			threads_ << " threads, " << std::setprecision(0) << (seconds_ > 0 ? messages / seconds_ : 0) <<
+			" msg/s (parallelism " << std::setprecision(2) << (seconds_ > 0 ? jobSeconds / seconds_ : 0) << "x)" << std::endl;
+}
@@ -0,0 +1,70 @@
+//============================================================================
+// Name        : BatchRunner.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Prices many independent feed files concurrently
+//============================================================================
+
+#ifndef BATCHRUNNER_H_
+#define BATCHRUNNER_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "MarketOrder.h"
+
+namespace trading {
+
+/**
+ * Batch Runner: one job per feed file (a day or an instrument, plain or compressed), each with its own book,
+ * run on a work-stealing thread pool. Results are merged in the order the files were added.
+ */
+class BatchRunner {
+public:
+	// Outcome of one feed file
+	struct Result {
+		std::string filename;
+		bool opened;                // false if the file could not be read
+		std::string output;         // "<timestamp> B|S <amount>" lines, as Pricer prints them
+		std::string errors;         // summary of skipped messages (empty if none)
+		unsigned long int messages; // messages read
+		unsigned long int skipped;  // messages rejected by the parser or the book
+		double seconds;             // wall time of the job
+	};
+
+	BatchRunner(const MarketOrder::Size& targetSize, bool conflate, std::size_t threads);
+
+	// Queue a feed file
+	void add(const std::string& filename);
+
+	// Price every queued feed; blocks until all jobs are done
+	void run();
+
+	// Per-job outputs to 'out', per-job and total throughput to 'stats'
+	void report(std::ostream& out, std::ostream& stats) const;
+
+	const std::vector<Result>& results() const;
+
+private:
+	// Price one feed file into 'result'
+	void price(Result& result) const;
+
+	MarketOrder::Size targetSize_;
+	bool conflate_;
+	std::size_t threads_;
+	std::vector<Result> results_;
+	double seconds_; // wall time of run()
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline const std::vector<trading::BatchRunner::Result>& trading::BatchRunner::results() const {
+	return results_;
+}
+
+#endif /* BATCHRUNNER_H_ */
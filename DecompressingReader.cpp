@@ -0,0 +1,265 @@
+//==========================================================================
+// Name        : DecompressingReader.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Line reader over compressed feed files, decompressing on a background thread
+//==========================================================================
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <csignal>
+#include <fstream>
+#include <spawn.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "DecompressingReader.h"
+#include "Log.h"
+
+extern char** environ;
+
+trading::DecompressingReader::Format trading::DecompressingReader::detect(const std::string& filename) {
+	std::ifstream is(filename.c_str(), std::ios::binary);
+	if (!is) {
+		throw BadMarketDataFile();
+	}
+
+	unsigned char magic[4] = {0, 0, 0, 0};
+	is.read(reinterpret_cast<char*>(magic), sizeof(magic));
+	if (is.gcount() >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		return gzip;
+	}
+	if (is.gcount() == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+		return zstd;
+	}
+	return plain;
+}
+
+trading::DecompressingReader::DecompressingReader(const std::string& filename)
+	: format_(detect(filename)), gz_(0), pipe_(0), child_(-1), reading_(0), pos_(0),
+	  eof_(false), failed_(false), stop_(false), ready_(-1) {
+
+	ready_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ready_ < 0) {
+		throw BadMarketDataFile();
+	}
+
+	if (format_ == zstd) { // zstd -dc <file> | us
+		int fds[2];
+		if (pipe(fds) != 0) {
+			throw BadMarketDataFile();
+		}
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+		posix_spawn_file_actions_addclose(&actions, fds[0]);
+		posix_spawn_file_actions_addclose(&actions, fds[1]);
+		const char* argv[] = {"zstd", "-dcq", "--", filename.c_str(), 0};
+		int error = posix_spawnp(&child_, "zstd", &actions, 0, const_cast<char**>(argv), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		::close(fds[1]);
+		if (error != 0) {
+			::close(fds[0]);
+			FILE_LOG(logERROR) << "Could not start zstd to read " << filename;
+			throw BadMarketDataFile();
+		}
+		pipe_ = fdopen(fds[0], "rb");
+	} else { // zlib reads plain files through unchanged
+		gz_ = gzopen(filename.c_str(), "rb");
+		if (gz_) {
+			gzbuffer(gz_, bufferSize);
+		}
+	}
+	if (!gz_ && !pipe_) {
+		close();
+		::close(ready_);
+		throw BadMarketDataFile();
+	}
+
+	for (std::size_t i = 0; i < 2; i++) {
+		buffers_[i].data.resize(bufferSize);
+		buffers_[i].size = 0;
+		buffers_[i].full = false;
+	}
+	producer_ = std::thread(&DecompressingReader::produce, this);
+}
+
+trading::DecompressingReader::~DecompressingReader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+		if (child_ > 0) {
+			kill(child_, SIGTERM); // unblock a producer waiting on the pipe
+		}
+	}
+	changed_.notify_all();
+	producer_.join();
+	close();
+	::close(ready_);
+}
+
+void trading::DecompressingReader::close() {
+	if (gz_) {
+		gzclose(gz_);
+		gz_ = 0;
+	}
+	if (pipe_) {
+		fclose(pipe_);
+		pipe_ = 0;
+	}
+	if (child_ > 0) {
+		int status;
+		waitpid(child_, &status, 0);
+		child_ = -1;
+	}
+}
+
+long int trading::DecompressingReader::decompress(char* out, std::size_t capacity) {
+	if (gz_) {
+		int n = gzread(gz_, out, static_cast<unsigned int>(capacity));
+		int error = Z_OK;
+		const char* message = gzerror(gz_, &error);
+		if (n <= 0 && error != Z_OK) { // includes a truncated stream, which gzread reports as the end
+			FILE_LOG(logERROR) << "gzip error: " << message;
+			return -1;
+		}
+		return n;
+	}
+
+	std::size_t n = fread(out, 1, capacity, pipe_);
+	if (n == 0 && ferror(pipe_)) {
+		return -1;
+	}
+	if (n == 0) { // end of the stream: did zstd finish cleanly?
+		pid_t child;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			child = child_;
+		}
+		int status = 0;
+		bool reaped = (child > 0 && waitpid(child, &status, 0) == child);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			child_ = -1;
+		}
+		if (reaped && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+			return -1;
+		}
+	}
+	return static_cast<long int>(n);
+}
+
+void trading::DecompressingReader::produce() {
+	std::size_t writing = 0;
+	while (true) {
+		Buffer& buffer = buffers_[writing];
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (buffer.full && !stop_) {
+				changed_.wait(lock);
+			}
+			if (stop_) {
+				return;
+			}
+		}
+
+		// Decompress outside the lock, while the consumer works on the other buffer
+		long int n = decompress(&buffer.data[0], buffer.data.size());
+		if (n < 0) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (stop_) { // zstd died of our SIGTERM, not of its input
+				return;
+			}
+			FILE_LOG(logERROR) << "Compressed feed is corrupt or truncated";
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (n <= 0) {
+				eof_ = true;
+				failed_ = (n < 0);
+			} else {
+				buffer.size = static_cast<std::size_t>(n);
+				buffer.full = true;
+			}
+			changed_.notify_all();
+		}
+		signal();
+		if (n <= 0) {
+			return;
+		}
+		writing ^= 1;
+	}
+}
+
+void trading::DecompressingReader::signal() {
+	uint64_t one = 1;
+	while (::write(ready_, &one, sizeof(one)) < 0 && errno == EINTR) {
+	}
+}
+
+bool trading::DecompressingReader::getline(std::string& line) {
+	line.clear();
+	return next(line, true) == gotLine;
+}
+
+trading::DecompressingReader::Poll trading::DecompressingReader::tryGetline(std::string& line) {
+	Poll result = next(partial_, false);
+	if (result == notYet) { // reset fd(), then look again in case the producer just filled a buffer
+		uint64_t signals;
+		while (::read(ready_, &signals, sizeof(signals)) < 0 && errno == EINTR) {
+		}
+		result = next(partial_, false);
+	}
+	if (result == gotLine) {
+		line.swap(partial_);
+		partial_.clear();
+	}
+	return result;
+}
+
+trading::DecompressingReader::Poll trading::DecompressingReader::next(std::string& line, bool wait) {
+	while (true) {
+		Buffer& buffer = buffers_[reading_];
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (wait && !buffer.full && !eof_) {
+				changed_.wait(lock);
+			}
+			if (!buffer.full && !eof_) {
+				return notYet;
+			}
+			if (!buffer.full) { // producer is done and everything has been consumed
+				return line.empty() ? atEnd : gotLine;
+			}
+		}
+
+		// The buffer is ours until we hand it back
+		const char* begin = &buffer.data[0] + pos_;
+		const char* end = &buffer.data[0] + buffer.size;
+		const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+		if (newline) {
+			line.append(begin, newline);
+			pos_ = newline + 1 - &buffer.data[0];
+			if (pos_ == buffer.size) {
+				std::lock_guard<std::mutex> lock(mutex_);
+				buffer.full = false;
+				reading_ ^= 1;
+				pos_ = 0;
+				changed_.notify_all();
+			}
+			return gotLine;
+		}
+
+		// Line continues in the next buffer
+		line.append(begin, end);
+		std::lock_guard<std::mutex> lock(mutex_);
+		buffer.full = false;
+		reading_ ^= 1;
+		pos_ = 0;
+		changed_.notify_all();
+	}
+}
@@ -0,0 +1,121 @@
+//============================================================================
+// Name        : DecompressingReader.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Line reader over compressed feed files, decompressing on a background thread
+//============================================================================
+
+#ifndef DECOMPRESSINGREADER_H_
+#define DECOMPRESSINGREADER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+#include "Exceptions.h"
+
+namespace trading {
+
+/**
+ * Decompressing Reader: a background thread decompresses the file block by block into one of
+ * two buffers while the caller splits the other one into lines. gzip is decoded with zlib;
+ * zstd by piping through the zstd tool, so that no extra library is needed.
+ */
+class DecompressingReader {
+public:
+	enum Format { plain, gzip, zstd };
+
+	// What tryGetline found
+	enum Poll { gotLine, notYet, atEnd };
+
+	// Format from the file's magic bytes; throws BadMarketDataFile if it cannot be read
+	static Format detect(const std::string& filename);
+
+	// Open the file and start decompressing; throws BadMarketDataFile if it cannot be opened
+	explicit DecompressingReader(const std::string& filename);
+
+	// Stops the background thread
+	~DecompressingReader();
+
+	// Next line (without '\n'); false at the end of the data
+	bool getline(std::string& line);
+
+	// Next line if it is already decompressed, without waiting; after notYet, wait for fd()
+	// to turn readable and try again
+	Poll tryGetline(std::string& line);
+
+	// Readable when tryGetline may have more (an eventfd)
+	int fd() const;
+
+	// False if decompression stopped on corrupt or truncated input
+	bool good() const;
+
+private:
+	enum { bufferSize = 1 << 20 };
+
+	struct Buffer {
+		std::vector<char> data;
+		std::size_t size;
+		bool full; // filled by the producer, not yet consumed
+	};
+
+	// Background thread: fill the buffers in turn until the input is exhausted
+	void produce();
+
+	// Background thread: make fd() readable
+	void signal();
+
+	// Append to 'line' until it is complete; notYet only if not 'wait'ing
+	Poll next(std::string& line, bool wait);
+
+	// Decompress up to 'capacity' bytes; 0 at the end, -1 on error
+	long int decompress(char* out, std::size_t capacity);
+
+	void close();
+
+	Format format_;
+	gzFile gz_;   // gzip (and plain) input
+	FILE* pipe_;  // zstd output
+	pid_t child_; // zstd process
+
+	Buffer buffers_[2];
+	std::size_t reading_; // buffer the consumer is on
+	std::size_t pos_;     // consumer position in it
+
+	mutable std::mutex mutex_;
+	std::condition_variable changed_;
+	bool eof_;    // producer is done
+	bool failed_; // ... because of an error
+	bool stop_;   // consumer is going away
+	std::thread producer_;
+
+	int ready_;           // eventfd behind fd()
+	std::string partial_; // tryGetline's line so far
+
+	DecompressingReader(DecompressingReader const&); // Don't Implement
+	void operator=(DecompressingReader const&);      // Don't implement
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline int trading::DecompressingReader::fd() const {
+	return ready_;
+}
+
+inline bool trading::DecompressingReader::good() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return !failed_;
+}
+
+#endif /* DECOMPRESSINGREADER_H_ */
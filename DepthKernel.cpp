@@ -0,0 +1,114 @@
+//==========================================================================
+// Name        : DepthKernel.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Vectorized fill of a target size over contiguous price levels
+//==========================================================================
+
+#include <immintrin.h>
+
+#include "DepthKernel.h"
+
+namespace {
+
+typedef bool (*FillLevels)(const uint64_t*, const uint64_t*, std::size_t, uint64_t, std::size_t&, double&);
+
+bool fillLevelsScalar(const uint64_t* sizes, const uint64_t* prices, std::size_t count, uint64_t target,
+		std::size_t& level, double& notional) {
+	uint64_t filled = 0;
+	uint64_t sum = 0;
+	for (std::size_t i = 0; i < count; i++) {
+		if (filled + sizes[i] >= target) {
+			level = i;
+			notional = static_cast<double>(sum + (target - filled) * prices[i]);
+			return true;
+		}
+		filled += sizes[i];
+		sum += sizes[i] * prices[i];
+	}
+	return false;
+}
+
+// Exact for values below 2^52: splice them into the mantissa of 2^52 and subtract it
+__attribute__((target("avx2"))) inline __m256d toDouble(__m256i values) {
+	const __m256i exponent = _mm256_set1_epi64x(0x4330000000000000LL);
+	return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(values, exponent)), _mm256_set1_pd(4503599627370496.0));
+}
+
+// Four levels per step: an in-register prefix sum of sizes finds the level that completes the fill,
+// and fused multiply-adds accumulate shares x price for the levels before it
+__attribute__((target("avx2,fma"))) bool fillLevelsAvx2(const uint64_t* sizes, const uint64_t* prices, std::size_t count,
+		uint64_t target, std::size_t& level, double& notional) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i wanted = _mm256_set1_epi64x(static_cast<long long>(target));
+	__m256i carry = zero;     // shares in the levels before this block, in every lane
+	__m256d sum = _mm256_setzero_pd();
+
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sizes + i));
+
+		// [a, b, c, d] -> [a, a+b, a+b+c, a+b+c+d] + carry
+		__m256i prefix = _mm256_add_epi64(s, _mm256_blend_epi32(_mm256_permute4x64_epi64(s, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x03));
+		prefix = _mm256_add_epi64(prefix, _mm256_blend_epi32(_mm256_permute4x64_epi64(prefix, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x0F));
+		prefix = _mm256_add_epi64(prefix, carry);
+
+		// Lanes still short of the target (sizes are far below 2^63, so the signed compare is safe)
+		int shortOf = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(wanted, prefix)));
+		if (shortOf != 0x0F) {
+			std::size_t lane = __builtin_ctz(~shortOf & 0x0F);
+			double partial[4];
+			_mm256_storeu_pd(partial, sum);
+			double total = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+
+			uint64_t filled = static_cast<uint64_t>(_mm256_extract_epi64(carry, 0));
+			for (std::size_t j = i; j < i + lane; j++) {
+				total += static_cast<double>(sizes[j] * prices[j]);
+				filled += sizes[j];
+			}
+			level = i + lane;
+			notional = total + static_cast<double>((target - filled) * prices[level]);
+			return true;
+		}
+
+		__m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + i));
+		sum = _mm256_fmadd_pd(toDouble(s), toDouble(p), sum);
+		carry = _mm256_permute4x64_epi64(prefix, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	// Fewer than four levels left
+	double partial[4];
+	_mm256_storeu_pd(partial, sum);
+	double total = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+	uint64_t filled = static_cast<uint64_t>(_mm256_extract_epi64(carry, 0)); // below target
+	double rest = 0;
+	if (!fillLevelsScalar(sizes + i, prices + i, count - i, target - filled, level, rest)) {
+		return false;
+	}
+	level += i;
+	notional = total + rest;
+	return true;
+}
+
+FillLevels chooseKernel() {
+	__builtin_cpu_init(); // may run before the runtime has probed the CPU
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return fillLevelsAvx2;
+	}
+	return fillLevelsScalar;
+}
+
+const FillLevels kernel = chooseKernel();
+
+} // end of anonymous namespace
+
+
+bool trading::fillLevels(const uint64_t* sizes, const uint64_t* prices, std::size_t count, uint64_t target,
+		std::size_t& level, double& notional) {
+	return kernel(sizes, prices, count, target, level, notional);
+}
+
+const char* trading::fillLevelsKernel() {
+	return (kernel == fillLevelsAvx2) ? "avx2" : "scalar";
+}
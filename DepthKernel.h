@@ -0,0 +1,29 @@
+//============================================================================
+// Name        : DepthKernel.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Vectorized fill of a target size over contiguous price levels
+//============================================================================
+
+#ifndef DEPTHKERNEL_H_
+#define DEPTHKERNEL_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace trading {
+
+// Walk 'count' levels, best first, until 'target' shares are filled: sets 'level' to the index of
+// the level that completes the fill and 'notional' to the sum of shares x price (in ticks).
+// Returns false if the levels hold fewer than 'target' shares.
+// Sizes, prices and the notional must stay below 2^52 (exact in a double).
+bool fillLevels(const uint64_t* sizes, const uint64_t* prices, std::size_t count, uint64_t target,
+		std::size_t& level, double& notional);
+
+// Kernel fillLevels dispatches to on this CPU: "avx2" or "scalar"
+const char* fillLevelsKernel();
+
+} // end of namespace
+
+#endif /* DEPTHKERNEL_H_ */
@@ -34,6 +34,42 @@ class OutOfBounds : public Exception {
 class BadMarketDataFile : public Exception {
 };
 
+// Missing, malformed or stale feed index
+class BadFeedIndex : public Exception {
+};
+
+/*
+ * Publication exceptions
+ */
+
+// Shared memory segment could not be created, mapped or recognized
+class BadSharedMemory : public Exception {
+};
+
+/*
+ * Query server exceptions
+ */
+
+// Query socket could not be created
+class BadQuerySocket : public Exception {
+};
+
+/*
+ * Network feed exceptions
+ */
+
+// Feed socket could not be created or bound
+class BadFeedSocket : public Exception {
+};
+
+/*
+ * Journal exceptions
+ */
+
+// Journal could not be opened or written, or is not a journal
+class BadJournal : public Exception {
+};
+
 /*
  * Parse Exceptions
  */
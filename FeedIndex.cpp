@@ -0,0 +1,214 @@
+//==========================================================================
+// Name        : FeedIndex.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Time index with book checkpoints for seeking into feed files
+//==========================================================================
+
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "DecompressingReader.h"
+#include "FeedIndex.h"
+#include "Log.h"
+#include "Parser.h"
+
+namespace {
+
+// Index file layout (text): a table of checkpoints, then one block of resting orders per
+// checkpoint, so that loading the index only reads the table
+//   FeedIndex 3 <feed size> <feed modification time, ns> <checkpoints>
+//   C <timestamp> <offset> <orders> <block offset, from the end of the table>
+//   ...
+//   <B|S> <id> <price in ticks> <size> <timestamp>   (one line per resting order)
+const char* const indexMagic = "FeedIndex";
+const int indexVersion = 3; // version 1 applied out of order messages; version 2 had no modification time
+
+std::streamoff fileSize(const std::string& filename) {
+	std::ifstream is(filename.c_str(), std::ios::binary | std::ios::ate);
+	if (!is) {
+		throw trading::BadMarketDataFile();
+	}
+	return is.tellg();
+}
+
+long long modificationTime(const std::string& filename) {
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0) {
+		throw trading::BadMarketDataFile();
+	}
+	return static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+} // end of anonymous namespace
+
+trading::FeedIndex::FeedIndex() : feedSize_(0), feedModified_(0), blocks_(0) {
+}
+
+trading::FeedIndex trading::FeedIndex::build(const std::string& feed, unsigned long int interval) {
+	FILE_LOG(logDEBUG) << "Building index for " << feed << " every " << interval << " messages";
+
+	if (DecompressingReader::detect(feed) != DecompressingReader::plain) { // offsets would not be seekable
+		FILE_LOG(logERROR) << "Cannot index compressed feed " << feed;
+		throw BadMarketDataFile();
+	}
+
+	std::ifstream is(feed.c_str(), std::ios::binary);
+	if (!is) {
+		throw BadMarketDataFile();
+	}
+
+	FeedIndex index;
+	index.feedSize_ = fileSize(feed);
+	index.feedModified_ = modificationTime(feed);
+
+	OrderBook book;
+	MarketOrder order;
+	OrderBook::Impact impact;
+	unsigned long int timestamp = 0;
+	unsigned long int messages = 0;
+	std::streamoff offset = 0;
+
+	std::string msg;
+	while (std::getline(is, msg)) {
+		offset += msg.size() + 1;
+		if (Parser::parse(msg, order) == success && order.timestamp >= timestamp) { // skip out of order messages, as PricingSession::apply does
+			timestamp = order.timestamp;
+			book.processOrder(order, impact);
+		}
+
+		if (++messages % interval == 0) {
+			Checkpoint checkpoint;
+			checkpoint.timestamp = timestamp;
+			checkpoint.offset = std::min(offset, index.feedSize_);
+			checkpoint.block = 0;
+			index.checkpoints_.push_back(checkpoint);
+			book.snapshot(index.checkpoints_.back().orders);
+			index.checkpoints_.back().orderCount = index.checkpoints_.back().orders.size();
+		}
+	}
+
+	FILE_LOG(logDEBUG) << "Indexed " << messages << " messages, " << index.checkpoints_.size() << " checkpoints";
+	return index;
+}
+
+trading::FeedIndex trading::FeedIndex::load(const std::string& path, const std::string& feed) {
+	std::ifstream is(path.c_str());
+	if (!is) {
+		throw BadFeedIndex();
+	}
+
+	FeedIndex index;
+	std::string magic;
+	int version = 0;
+	std::size_t count = 0;
+	if (!(is >> magic >> version) || magic != indexMagic || version != indexVersion) {
+		throw BadFeedIndex();
+	}
+	if (!(is >> index.feedSize_ >> index.feedModified_ >> count)) {
+		throw BadFeedIndex();
+	}
+	if (index.feedSize_ != fileSize(feed) || index.feedModified_ != modificationTime(feed)) { // feed changed since the index was built
+		throw BadFeedIndex();
+	}
+
+	index.checkpoints_.resize(count);
+	for (std::size_t i = 0; i < count; i++) {
+		Checkpoint& checkpoint = index.checkpoints_[i];
+		std::string tag;
+		if (!(is >> tag >> checkpoint.timestamp >> checkpoint.offset >> checkpoint.orderCount >> checkpoint.block) || tag != "C") {
+			throw BadFeedIndex();
+		}
+	}
+
+	index.path_ = path;
+	index.blocks_ = static_cast<std::streamoff>(is.tellg()) + 1; // past the table's last newline
+	return index;
+}
+
+trading::FeedIndex trading::FeedIndex::open(const std::string& feed, unsigned long int interval) {
+	std::string path = sidecarPath(feed);
+	try {
+		return load(path, feed);
+	} catch (const BadFeedIndex&) {
+		FILE_LOG(logDEBUG) << "No usable index at " << path << "; building one";
+	}
+
+	FeedIndex index = build(feed, interval);
+	try {
+		index.save(path);
+	} catch (const BadFeedIndex&) {
+		FILE_LOG(logERROR) << "Could not write the feed index " << path;
+	}
+	return index;
+}
+
+void trading::FeedIndex::save(const std::string& path) {
+	std::ofstream os(path.c_str());
+	if (!os) {
+		throw BadFeedIndex();
+	}
+
+	// Blocks first, to know where each one starts
+	std::ostringstream blocks;
+	for (std::size_t i = 0; i < checkpoints_.size(); i++) {
+		Checkpoint& checkpoint = checkpoints_[i];
+		checkpoint.block = blocks.tellp();
+		for (std::size_t j = 0; j < checkpoint.orders.size(); j++) {
+			const MarketOrder& order = checkpoint.orders[j];
+			blocks << (order.side == buy ? "B " : "S ") << order.id << " " << order.price << " " << order.size << " " <<
+					order.timestamp << "\n";
+		}
+	}
+
+	os << indexMagic << " " << indexVersion << " " << feedSize_ << " " << feedModified_ << " " << checkpoints_.size() << "\n";
+	for (std::size_t i = 0; i < checkpoints_.size(); i++) {
+		const Checkpoint& checkpoint = checkpoints_[i];
+		os << "C " << checkpoint.timestamp << " " << checkpoint.offset << " " << checkpoint.orderCount << " " <<
+				checkpoint.block << "\n";
+	}
+	os << blocks.str();
+
+	if (!os.flush()) {
+		throw BadFeedIndex();
+	}
+}
+
+const trading::FeedIndex::Checkpoint* trading::FeedIndex::checkpointAt(unsigned long int timestamp) const {
+	const Checkpoint* found = 0;
+	for (std::size_t i = 0; i < checkpoints_.size() && checkpoints_[i].timestamp <= timestamp; i++) {
+		found = &checkpoints_[i];
+	}
+	return found;
+}
+
+void trading::FeedIndex::restore(const Checkpoint& checkpoint, OrderBook& book) const {
+	std::vector<MarketOrder> loaded;
+	const std::vector<MarketOrder>* orders = &checkpoint.orders;
+
+	if (checkpoint.orders.size() != checkpoint.orderCount) { // loaded index: read the checkpoint's block
+		std::ifstream is(path_.c_str());
+		if (!is || !is.seekg(blocks_ + checkpoint.block)) {
+			throw BadFeedIndex();
+		}
+
+		loaded.resize(checkpoint.orderCount);
+		for (std::size_t i = 0; i < loaded.size(); i++) {
+			MarketOrder& order = loaded[i];
+			std::string side;
+			if (!(is >> side >> order.id >> order.price >> order.size >> order.timestamp) || (side != "B" && side != "S")) {
+				throw BadFeedIndex();
+			}
+			order.type = add;
+			order.side = (side == "B") ? buy : sell;
+		}
+		orders = &loaded;
+	}
+
+	OrderBook::Impact impact;
+	for (std::size_t i = 0; i < orders->size(); i++) {
+		book.processOrder((*orders)[i], impact);
+	}
+}
@@ -0,0 +1,88 @@
+//============================================================================
+// Name        : FeedIndex.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Time index with book checkpoints for seeking into feed files
+//============================================================================
+
+#ifndef FEEDINDEX_H_
+#define FEEDINDEX_H_
+
+#include <ios>
+#include <string>
+#include <vector>
+
+#include "Exceptions.h"
+#include "MarketOrder.h"
+#include "OrderBook.h"
+
+namespace trading {
+
+/**
+ * Feed Index: timestamp -> byte offset, each entry carrying a checkpoint of the book at that
+ * offset. Built in one pass over the feed and kept next to it as "<feed>.idx", so that a run
+ * can restore the nearest checkpoint before a given time and replay only the tail.
+ */
+class FeedIndex {
+public:
+	// Book state after every message before 'offset'
+	struct Checkpoint {
+		unsigned long int timestamp;     // timestamp of the last message applied
+		std::streamoff offset;           // byte offset of the next message
+		std::size_t orderCount;          // resting orders at the checkpoint
+		std::streamoff block;            // where they are stored in the index file
+		std::vector<MarketOrder> orders; // the orders, see OrderBook::snapshot (empty until needed if loaded)
+	};
+
+	// Messages between checkpoints
+	enum { defaultInterval = 10000 };
+
+	// Replay the feed once, checkpointing every 'interval' messages
+	static FeedIndex build(const std::string& feed, unsigned long int interval);
+
+	// Load an index (checkpoint orders are read on restore); throws BadFeedIndex if it is missing,
+	// malformed, or built for another version of the feed (its size or modification time differs)
+	static FeedIndex load(const std::string& path, const std::string& feed);
+
+	// Load the feed's sidecar index, building and saving it first if it is missing or stale
+	static FeedIndex open(const std::string& feed, unsigned long int interval);
+
+	// Write the index; throws BadFeedIndex if the file cannot be written
+	void save(const std::string& path);
+
+	// "<feed>.idx"
+	static std::string sidecarPath(const std::string& feed);
+
+	// Latest checkpoint taken at or before 'timestamp', or 0 if the feed must be replayed from the start
+	const Checkpoint* checkpointAt(unsigned long int timestamp) const;
+
+	// Load a checkpoint into an empty book; throws BadFeedIndex if its orders cannot be read
+	void restore(const Checkpoint& checkpoint, OrderBook& book) const;
+
+	const std::vector<Checkpoint>& checkpoints() const;
+
+private:
+	FeedIndex();
+
+	std::streamoff feedSize_; // to detect an index built for another version of the feed ...
+	long long feedModified_;  // ... including one rewritten to the same size (ns since the epoch)
+	std::vector<Checkpoint> checkpoints_;
+	std::string path_;        // index file the checkpoint blocks live in
+	std::streamoff blocks_;   // offset of the first block in it
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline std::string trading::FeedIndex::sidecarPath(const std::string& feed) {
+	return feed + ".idx";
+}
+
+inline const std::vector<trading::FeedIndex::Checkpoint>& trading::FeedIndex::checkpoints() const {
+	return checkpoints_;
+}
+
+#endif /* FEEDINDEX_H_ */
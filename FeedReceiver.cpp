@@ -0,0 +1,310 @@
+//==========================================================================
+// Name        : FeedReceiver.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Market data over TCP and UDP sockets
+//==========================================================================
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "FeedReceiver.h"
+#include "Log.h"
+
+trading::FeedReceiver::FeedReceiver() : feedsAccepted_(0), feedsOpen_(0), udpSockets_(0) {
+	epoll_ = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_ < 0) {
+		throw BadFeedSocket();
+	}
+	reserve_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+trading::FeedReceiver::~FeedReceiver() {
+	while (!connections_.empty()) {
+		close(connections_.begin()->first);
+	}
+	if (reserve_ >= 0) {
+		::close(reserve_);
+	}
+	::close(epoll_);
+}
+
+void trading::FeedReceiver::listen(const std::string& spec) {
+	// "tcp:9000", "udp:127.0.0.1:9001"
+	std::string::size_type colon = spec.find(':');
+	std::string::size_type last = spec.rfind(':');
+	std::string protocol = spec.substr(0, colon);
+	std::string host = (last != colon) ? spec.substr(colon + 1, last - colon - 1) : "127.0.0.1";
+	int port = std::atoi(spec.c_str() + last + 1);
+
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (colon == std::string::npos || (protocol != "tcp" && protocol != "udp") || port <= 0 || port > 65535 ||
+			inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+		FILE_LOG(logERROR) << "Expected tcp:[host:]port or udp:[host:]port, got " << spec;
+		throw BadFeedSocket();
+	}
+
+	bool tcp = (protocol == "tcp");
+	int fd = socket(AF_INET, (tcp ? SOCK_STREAM : SOCK_DGRAM) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	int on = 1;
+	if (fd >= 0) {
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	}
+	if (fd < 0 || bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+			(tcp && ::listen(fd, SOMAXCONN) != 0)) {
+		FILE_LOG(logERROR) << "Could not listen on " << spec << ": " << std::strerror(errno);
+		if (fd >= 0) {
+			::close(fd);
+		}
+		throw BadFeedSocket();
+	}
+
+	if (!tcp) {
+		int size = 1 << 22; // absorb bursts while the book is busy
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		udpSockets_++;
+	}
+	add(fd, tcp ? tcpListener : udpFeed, spec);
+	FILE_LOG(logDEBUG) << "Listening for market data on " << spec;
+}
+
+void trading::FeedReceiver::add(int fd, Kind kind, const std::string& label) {
+	Connection& connection = connections_[fd];
+	connection.kind = kind;
+	connection.label = label;
+	connection.head = 0;
+	connection.tail = 0;
+	connection.scan = 0;
+	connection.discarding = false;
+	if (kind == tcpFeed) {
+		connection.ring.resize(ringSize);
+	}
+
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLET;
+	event.data.fd = fd;
+	epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event);
+}
+
+void trading::FeedReceiver::receive(std::vector<std::string>& batch, int timeoutMs) {
+	enum { maxEvents = 64 };
+	struct epoll_event events[maxEvents];
+
+	// Sockets left with data last round come first; edge-triggered, they are not reported again
+	std::vector<int> ready(backlog_.begin(), backlog_.end());
+	backlog_.clear();
+	int n = epoll_wait(epoll_, events, maxEvents, ready.empty() ? timeoutMs : 0);
+	for (int i = 0; i < n; i++) {
+		ready.push_back(events[i].data.fd);
+	}
+
+	for (std::size_t i = 0; i < ready.size(); i++) {
+		int fd = ready[i];
+		std::map<int, Connection>::iterator it = connections_.find(fd);
+		if (it == connections_.end()) {
+			continue; // closed earlier in this round
+		}
+		switch (it->second.kind) {
+		case tcpListener:
+			accept(fd);
+			break;
+		case tcpFeed:
+			readStream(fd, it->second, batch);
+			break;
+		case udpFeed:
+			readDatagrams(fd, batch);
+			break;
+		}
+	}
+}
+
+void trading::FeedReceiver::accept(int fd) {
+	// Edge-triggered: take every pending connection
+	while (true) {
+		struct sockaddr_in peer;
+		socklen_t length = sizeof(peer);
+		int feed = accept4(fd, reinterpret_cast<struct sockaddr*>(&peer), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (feed < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			if ((errno == EMFILE || errno == ENFILE) && reserve_ >= 0) {
+				// Out of descriptors: the connection would stay pending and, edge-triggered, the
+				// listener would never be reported again, so free the reserve to accept and drop it
+				::close(reserve_);
+				int dropped = accept4(fd, 0, 0, SOCK_CLOEXEC);
+				if (dropped >= 0) {
+					::close(dropped);
+					FILE_LOG(logERROR) << "Out of file descriptors; refused a feed on " << connections_[fd].label;
+				}
+				reserve_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+				if (dropped >= 0) {
+					continue;
+				}
+				return; // nothing was pending
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				FILE_LOG(logERROR) << "Error accepting a feed on " << connections_[fd].label << ": " << std::strerror(errno);
+			}
+			return;
+		}
+		char host[INET_ADDRSTRLEN];
+		inet_ntop(AF_INET, &peer.sin_addr, host, sizeof(host));
+		std::ostringstream label;
+		label << connections_[fd].label << " from " << host << ":" << ntohs(peer.sin_port);
+
+		add(feed, tcpFeed, label.str());
+		feedsAccepted_++;
+		feedsOpen_++;
+		FILE_LOG(logDEBUG) << "Feed connected: " << label.str();
+	}
+}
+
+void trading::FeedReceiver::readStream(int fd, Connection& connection, std::vector<std::string>& batch) {
+	const unsigned long int mask = ringSize - 1;
+
+	// Edge-triggered: read until the socket would block, or note it in the backlog
+	unsigned long int taken = 0;
+	while (true) {
+		if (taken >= bytesPerRound) {
+			backlog_.insert(fd);
+			return;
+		}
+		if (connection.tail - connection.head == ringSize) { // no newline in a full ring
+			FILE_LOG(logERROR) << "Dropping a message longer than " << ringSize << " bytes from " << connection.label;
+			connection.head = connection.tail;
+			connection.scan = connection.tail;
+			connection.discarding = true;
+		}
+
+		// Free space, in at most two pieces
+		unsigned long int start = connection.tail & mask;
+		unsigned long int free = ringSize - (connection.tail - connection.head);
+		struct iovec pieces[2];
+		pieces[0].iov_base = &connection.ring[start];
+		pieces[0].iov_len = std::min(free, ringSize - start);
+		pieces[1].iov_base = &connection.ring[0];
+		pieces[1].iov_len = free - pieces[0].iov_len;
+
+		ssize_t n = readv(fd, pieces, pieces[1].iov_len ? 2 : 1);
+		if (n > 0) {
+			connection.tail += n;
+			taken += n;
+			extractLines(connection, batch);
+			continue;
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		}
+
+		// End of feed: a last line without a newline still counts, as with a file
+		if (n < 0) {
+			FILE_LOG(logERROR) << "Error reading " << connection.label << ": " << std::strerror(errno);
+		}
+		std::string rest;
+		for (unsigned long int i = connection.head; i != connection.tail && !connection.discarding; i++) {
+			rest += connection.ring[i & mask];
+		}
+		splitLines(rest.data(), rest.size(), batch);
+		FILE_LOG(logDEBUG) << "Feed disconnected: " << connection.label;
+		close(fd);
+		return;
+	}
+}
+
+void trading::FeedReceiver::extractLines(Connection& connection, std::vector<std::string>& batch) {
+	const unsigned long int mask = ringSize - 1;
+	for (unsigned long int i = connection.scan; i != connection.tail; i++) { // bytes before scan hold no newline
+		if (connection.ring[i & mask] != '\n') {
+			continue;
+		}
+		if (connection.discarding) { // the tail of an overflowed line
+			connection.discarding = false;
+			connection.head = i + 1;
+			continue;
+		}
+		unsigned long int end = i;
+		if (end > connection.head && connection.ring[(end - 1) & mask] == '\r') {
+			end--;
+		}
+		if (end > connection.head) {
+			unsigned long int from = connection.head & mask;
+			unsigned long int length = end - connection.head;
+			std::string msg(&connection.ring[from], std::min(length, ringSize - from));
+			if (msg.size() < length) {
+				msg.append(&connection.ring[0], length - msg.size()); // wrapped around
+			}
+			batch.push_back(msg);
+		}
+		connection.head = i + 1;
+	}
+	connection.scan = connection.tail;
+	if (connection.discarding) { // no need to keep what will be dropped
+		connection.head = connection.tail;
+	}
+}
+
+void trading::FeedReceiver::readDatagrams(int fd, std::vector<std::string>& batch) {
+	char buffer[65536];
+	unsigned long int taken = 0;
+	while (true) {
+		if (taken >= bytesPerRound) {
+			backlog_.insert(fd);
+			return;
+		}
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n >= 0) {
+			splitLines(buffer, n, batch);
+			taken += n + 1; // empty datagrams count too
+		} else if (errno != EINTR) {
+			return; // EAGAIN: drained
+		}
+	}
+}
+
+void trading::FeedReceiver::splitLines(const char* data, std::size_t size, std::vector<std::string>& batch) {
+	std::size_t begin = 0;
+	while (begin < size) {
+		const char* newline = static_cast<const char*>(std::memchr(data + begin, '\n', size - begin));
+		std::size_t end = newline ? newline - data : size;
+		std::size_t next = end + 1;
+		if (end > begin && data[end - 1] == '\r') {
+			end--;
+		}
+		if (end > begin) {
+			batch.push_back(std::string(data + begin, end - begin));
+		}
+		begin = next;
+	}
+}
+
+void trading::FeedReceiver::close(int fd) {
+	std::map<int, Connection>::iterator it = connections_.find(fd);
+	if (it->second.kind == tcpFeed) {
+		feedsOpen_--;
+	} else if (it->second.kind == udpFeed) {
+		udpSockets_--;
+	}
+	epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, 0);
+	::close(fd);
+	connections_.erase(it);
+	backlog_.erase(fd);
+}
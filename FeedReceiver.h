@@ -0,0 +1,116 @@
+//============================================================================
+// Name        : FeedReceiver.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Market data over TCP and UDP sockets
+//============================================================================
+
+#ifndef FEEDRECEIVER_H_
+#define FEEDRECEIVER_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Exceptions.h"
+
+namespace trading {
+
+/**
+ * Feed Receiver: one epoll set for any number of TCP listeners, TCP feed connections and UDP
+ * sockets, all non-blocking and edge-triggered. Each TCP connection reads into its own ring
+ * buffer; receive() hands back the complete lines that arrived, in arrival order per socket.
+ * UDP datagrams carry one or more whole lines. A socket gives at most bytesPerRound per call,
+ * so one fast sender cannot starve the others; the rest is read on the next call. Not
+ * thread-safe.
+ */
+class FeedReceiver {
+public:
+	enum {
+		ringSize = 1 << 16,     // ring buffer per TCP connection; a longer line is dropped up to its newline
+		bytesPerRound = 1 << 16 // read from one socket per receive() at most
+	};
+
+	// Throws BadFeedSocket
+	FeedReceiver();
+
+	// Closes every socket
+	~FeedReceiver();
+
+	// Accept feeds on "tcp:[host:]port" or receive them on "udp:[host:]port" (host defaults
+	// to 127.0.0.1); throws BadFeedSocket
+	void listen(const std::string& spec);
+
+	// Wait up to 'timeoutMs' (-1 = forever; never while backlogged()) and append the complete
+	// messages received to 'batch'
+	void receive(std::vector<std::string>& batch, int timeoutMs);
+
+	// Did a socket have more to give than the last receive() took? Then fd() may not turn
+	// readable again for it, so call receive() without waiting
+	bool backlogged() const;
+
+	// Can more messages arrive? False once all the TCP feeds that connected have hung up
+	// (and there are no UDP sockets), like the end of a file
+	bool active() const;
+
+	// Readable when receive() has something to do, for use in another poll loop
+	int fd() const;
+
+private:
+	enum Kind { tcpListener, tcpFeed, udpFeed };
+
+	struct Connection {
+		Kind kind;
+		std::string label;     // for logging
+		std::vector<char> ring;
+		unsigned long int head; // next unconsumed byte (positions grow forever; index with & mask)
+		unsigned long int tail; // next byte to write
+		unsigned long int scan; // next byte to search for a newline
+		bool discarding;        // dropping the rest of a line that overflowed the ring
+	};
+
+	void accept(int fd);
+	void readStream(int fd, Connection& connection, std::vector<std::string>& batch);
+	void readDatagrams(int fd, std::vector<std::string>& batch);
+	void close(int fd);
+
+	// Move complete lines out of the connection's ring
+	static void extractLines(Connection& connection, std::vector<std::string>& batch);
+
+	// Split a datagram (or the last bytes of a stream) into lines
+	static void splitLines(const char* data, std::size_t size, std::vector<std::string>& batch);
+
+	void add(int fd, Kind kind, const std::string& label);
+
+	int epoll_;
+	int reserve_; // spare descriptor, given up to accept and drop a feed when out of descriptors
+	std::map<int, Connection> connections_;
+	std::set<int> backlog_; // sockets left unread at bytesPerRound
+	unsigned long int feedsAccepted_;
+	unsigned long int feedsOpen_;
+	unsigned long int udpSockets_;
+
+	FeedReceiver(FeedReceiver const&);  // Don't Implement
+	void operator=(FeedReceiver const&); // Don't implement
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline bool trading::FeedReceiver::active() const {
+	return udpSockets_ > 0 || feedsOpen_ > 0 || feedsAccepted_ == 0;
+}
+
+inline bool trading::FeedReceiver::backlogged() const {
+	return !backlog_.empty();
+}
+
+inline int trading::FeedReceiver::fd() const {
+	return epoll_;
+}
+
+#endif /* FEEDRECEIVER_H_ */
@@ -0,0 +1,261 @@
+//==========================================================================
+// Name        : FeedScheduler.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Many feeds on one thread with C++20 coroutines over epoll
+//==========================================================================
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Exceptions.h"
+#include "FeedScheduler.h"
+#include "Log.h"
+
+trading::FeedScheduler::FeedScheduler() {
+	epoll_ = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_ < 0) {
+		throw BadFeedSocket();
+	}
+}
+
+trading::FeedScheduler::~FeedScheduler() {
+	close(epoll_);
+}
+
+void trading::FeedScheduler::Readable::await_suspend(std::coroutine_handle<> handle) {
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = handle.address();
+
+	bool known = scheduler.watched_.count(fd) > 0;
+	if (epoll_ctl(scheduler.epoll_, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) == 0) {
+		scheduler.watched_.insert(fd);
+	} else {
+		scheduler.ready_.push_back(handle); // EPERM: a regular file, never worth waiting for
+	}
+}
+
+void trading::FeedScheduler::forget(int fd) {
+	if (watched_.erase(fd)) {
+		epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, 0);
+	}
+}
+
+void trading::FeedScheduler::spawn(FeedTask task) {
+	ready_.push_back(task.handle());
+	tasks_.push_back(std::move(task));
+}
+
+void trading::FeedScheduler::run() {
+	enum { maxEvents = 256 };
+	struct epoll_event events[maxEvents];
+	std::size_t finished = 0;
+
+	while (finished < tasks_.size()) {
+		// Block only when no feed has work in hand
+		int n = epoll_wait(epoll_, events, maxEvents, ready_.empty() ? -1 : 0);
+		for (int i = 0; i < n; i++) {
+			ready_.push_back(std::coroutine_handle<>::from_address(events[i].data.ptr));
+		}
+
+		// One turn for each feed that was ready at the start of this round
+		for (std::size_t turns = ready_.size(); turns > 0; turns--) {
+			std::coroutine_handle<> handle = ready_.front();
+			ready_.pop_front();
+			handle.resume();
+			if (handle.done()) {
+				finished++;
+			}
+		}
+	}
+}
+
+trading::FeedMultiplexer::Feed::Feed(const std::string& name, int fd, const MarketOrder::Size& targetSize)
+	: name(name), fd(fd), savedFlags(-1), fifo(false), session(book, targetSize, output), messages(0) {
+}
+
+trading::FeedMultiplexer::Feed::~Feed() {
+	close();
+}
+
+void trading::FeedMultiplexer::Feed::close() {
+	if (fd < 0) {
+		return;
+	}
+	if (savedFlags >= 0) { // the dup shares the open file description with the caller's stdin
+		fcntl(fd, F_SETFL, savedFlags);
+	}
+	::close(fd);
+	fd = -1;
+}
+
+trading::FeedMultiplexer::FeedMultiplexer(const MarketOrder::Size& targetSize, bool conflate, std::ostream& out)
+	: targetSize_(targetSize), conflate_(conflate), out_(out) {
+}
+
+bool trading::FeedMultiplexer::add(const std::string& name) {
+	struct stat st;
+	if (name != "-" && stat(name.c_str(), &st) == 0 && S_ISREG(st.st_mode)) { // FIFOs cannot be sniffed without consuming them
+		std::unique_ptr<DecompressingReader> reader;
+		try {
+			if (DecompressingReader::detect(name) != DecompressingReader::plain) {
+				reader.reset(new DecompressingReader(name));
+			}
+		} catch (const BadMarketDataFile&) {
+			FILE_LOG(logERROR) << "Could not open the feed " << name;
+			return false;
+		}
+		if (reader) {
+			feeds_.push_back(std::unique_ptr<Feed>(new Feed(name, -1, targetSize_)));
+			feeds_.back()->reader = std::move(reader);
+			return true;
+		}
+	}
+
+	// O_NONBLOCK also keeps open() from waiting for a FIFO's writer
+	int fd = (name == "-") ? dup(0) : open(name.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		FILE_LOG(logERROR) << "Could not open the feed " << name << ": " << std::strerror(errno);
+		return false;
+	}
+	std::unique_ptr<Feed> feed(new Feed(name, fd, targetSize_));
+	if (name == "-") {
+		feed->savedFlags = fcntl(fd, F_GETFL);
+		fcntl(fd, F_SETFL, feed->savedFlags | O_NONBLOCK);
+	} else {
+		feed->fifo = fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+	}
+	feeds_.push_back(std::move(feed));
+	return true;
+}
+
+void trading::FeedMultiplexer::run() {
+	for (std::size_t i = 0; i < feeds_.size(); i++) {
+		scheduler_.spawn(feeds_[i]->reader ? priceCompressed(*feeds_[i]) : price(*feeds_[i]));
+	}
+	scheduler_.run();
+}
+
+trading::FeedTask trading::FeedMultiplexer::price(Feed& feed) {
+	char buffer[16384];
+	std::string partial; // line split across reads
+	std::vector<std::string> lines;
+
+	// Until a writer opens it, a FIFO reads as ended; epoll only reports it once one has
+	if (feed.fifo) {
+		co_await scheduler_.readable(feed.fd);
+	}
+
+	while (true) {
+		ssize_t n = read(feed.fd, buffer, sizeof(buffer));
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			co_await scheduler_.readable(feed.fd);
+			continue;
+		}
+		if (n <= 0) {
+			if (n < 0) {
+				FILE_LOG(logERROR) << "Error reading the feed " << feed.name << ": " << std::strerror(errno);
+			}
+			break;
+		}
+
+		lines.clear();
+		const char* begin = buffer;
+		const char* end = buffer + n;
+		for (const char* newline; (newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin))); begin = newline + 1) {
+			partial.append(begin, newline);
+			lines.push_back(partial);
+			partial.clear();
+		}
+		partial.append(begin, end);
+		apply(feed, lines);
+
+		co_await scheduler_.yield();
+	}
+
+	// A last line without a newline still counts, as with a file
+	lines.clear();
+	if (!partial.empty()) {
+		lines.push_back(partial);
+	}
+	apply(feed, lines);
+
+	scheduler_.forget(feed.fd);
+	feed.close();
+}
+
+trading::FeedTask trading::FeedMultiplexer::priceCompressed(Feed& feed) {
+	std::string line;
+	std::vector<std::string> lines;
+
+	// Take only what the decoder thread has ready; never block this thread on it
+	DecompressingReader::Poll poll = DecompressingReader::gotLine;
+	while (poll != DecompressingReader::atEnd) {
+		lines.clear();
+		while (lines.size() < linesPerTurn && (poll = feed.reader->tryGetline(line)) == DecompressingReader::gotLine) {
+			lines.push_back(line);
+		}
+		apply(feed, lines);
+
+		if (poll == DecompressingReader::notYet) {
+			co_await scheduler_.readable(feed.reader->fd());
+		} else {
+			co_await scheduler_.yield();
+		}
+	}
+
+	if (!feed.reader->good()) {
+		FILE_LOG(logERROR) << "The feed " << feed.name << " is corrupt or truncated";
+	}
+	scheduler_.forget(feed.reader->fd());
+	feed.reader.reset();
+}
+
+void trading::FeedMultiplexer::apply(Feed& feed, const std::vector<std::string>& lines) {
+	for (std::size_t i = 0; i < lines.size(); i++) {
+		feed.session.apply(lines[i]);
+		feed.messages++;
+
+		// In conflation mode, reprice once per chunk read
+		if (conflate_ && i + 1 < lines.size()) {
+			continue;
+		}
+		if (feed.session.repriceDue()) {
+			feed.session.reprice();
+		}
+	}
+
+	// Prefix each output line with the feed name
+	std::string output = feed.output.str();
+	if (output.empty()) {
+		return;
+	}
+	feed.output.str(std::string());
+	std::string::size_type begin = 0;
+	for (std::string::size_type newline; (newline = output.find('\n', begin)) != std::string::npos; begin = newline + 1) {
+		out_ << feed.name << " ";
+		out_.write(output.data() + begin, newline + 1 - begin);
+	}
+	out_.flush();
+}
+
+void trading::FeedMultiplexer::report(std::ostream& stats) const {
+	for (std::size_t i = 0; i < feeds_.size(); i++) {
+		const Feed& feed = *feeds_[i];
+		stats << feed.name << ": " << feed.messages << " messages";
+		if (feed.session.counters().errors() > 0) {
+			stats << "; " << feed.session.errorSummary();
+		}
+		stats << std::endl;
+	}
+}
@@ -0,0 +1,197 @@
+//============================================================================
+// Name        : FeedScheduler.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Many feeds on one thread with C++20 coroutines over epoll
+//============================================================================
+
+#ifndef FEEDSCHEDULER_H_
+#define FEEDSCHEDULER_H_
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DecompressingReader.h"
+#include "MarketOrder.h"
+#include "OrderBook.h"
+#include "PricingSession.h"
+
+namespace trading {
+
+/**
+ * Feed Task: coroutine handle owned by the scheduler. Starts suspended; the scheduler
+ * resumes it until it finishes.
+ */
+class FeedTask {
+public:
+	struct promise_type {
+		FeedTask get_return_object() { return FeedTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+		std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+		void return_void() { }
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	explicit FeedTask(std::coroutine_handle<promise_type> handle);
+	FeedTask(FeedTask&& other) noexcept;
+	~FeedTask();
+
+	std::coroutine_handle<promise_type> handle() const;
+
+private:
+	std::coroutine_handle<promise_type> handle_;
+
+	FeedTask(FeedTask const&);         // Don't Implement
+	void operator=(FeedTask const&);   // Don't implement
+};
+
+/**
+ * Feed Scheduler: runs feed coroutines on the calling thread. A feed suspends when its
+ * descriptor has nothing to read (co_await readable(fd)) and after each chunk it applies
+ * (co_await yield()), so hundreds of feeds share one core fairly and every book is only
+ * touched by this thread.
+ */
+class FeedScheduler {
+public:
+	// Throws BadFeedSocket if epoll is unavailable
+	FeedScheduler();
+	~FeedScheduler();
+
+	// Suspend until 'fd' is readable (regular files always are)
+	struct Readable {
+		FeedScheduler& scheduler;
+		int fd;
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle);
+		void await_resume() const noexcept { }
+	};
+	Readable readable(int fd);
+
+	// Let the other ready feeds run first
+	struct Yield {
+		FeedScheduler& scheduler;
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle) { scheduler.ready_.push_back(handle); }
+		void await_resume() const noexcept { }
+	};
+	Yield yield();
+
+	// Stop watching 'fd' (before closing it)
+	void forget(int fd);
+
+	// Take a task; it first runs inside run()
+	void spawn(FeedTask task);
+
+	// Run until every task has finished
+	void run();
+
+private:
+	int epoll_;
+	std::set<int> watched_;                    // registered with epoll (one-shot)
+	std::deque<std::coroutine_handle<> > ready_;
+	std::vector<FeedTask> tasks_;
+
+	FeedScheduler(FeedScheduler const&);   // Don't Implement
+	void operator=(FeedScheduler const&);  // Don't implement
+};
+
+/**
+ * Multiplexed Pricer: one book and pricing session per feed (file, FIFO or "-" for standard input),
+ * all driven by one FeedScheduler. Output lines are prefixed with the feed name. Compressed files
+ * are decoded by a DecompressingReader on its own thread (plus a zstd process for .zst) and handed
+ * over in turns of the lines it already has; the scheduler waits on the reader's eventfd otherwise.
+ */
+class FeedMultiplexer {
+public:
+	enum { linesPerTurn = 1024 }; // compressed feeds: lines applied before yielding
+
+	FeedMultiplexer(const MarketOrder::Size& targetSize, bool conflate, std::ostream& out);
+
+	// Open a feed; false if it cannot be opened
+	bool add(const std::string& name);
+
+	// Price every feed to its end
+	void run();
+
+	// Per-feed message counts and errors
+	void report(std::ostream& stats) const;
+
+private:
+	struct Feed {
+		std::string name;
+		int fd;                                     // -1 for a compressed file ...
+		std::unique_ptr<DecompressingReader> reader; // ... read through this instead
+		int savedFlags;                             // standard input's flags before O_NONBLOCK; -1 if not shared
+		bool fifo;                                  // no writer may have opened it yet
+		OrderBook book;
+		std::ostringstream output;
+		PricingSession session;
+		unsigned long int messages;
+
+		Feed(const std::string& name, int fd, const MarketOrder::Size& targetSize);
+		~Feed();
+
+		// Close fd, giving standard input back as it was
+		void close();
+	};
+
+	// The coroutine behind each feed
+	FeedTask price(Feed& feed);
+
+	// ... and behind each compressed file
+	FeedTask priceCompressed(Feed& feed);
+
+	// Apply complete lines, then move the session's output to out_
+	void apply(Feed& feed, const std::vector<std::string>& lines);
+
+	MarketOrder::Size targetSize_;
+	bool conflate_;
+	std::ostream& out_;
+	std::vector<std::unique_ptr<Feed> > feeds_;
+	FeedScheduler scheduler_;
+
+	FeedMultiplexer(FeedMultiplexer const&);  // Don't Implement
+	void operator=(FeedMultiplexer const&);   // Don't implement
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline trading::FeedTask::FeedTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {
+}
+
+inline trading::FeedTask::FeedTask(FeedTask&& other) noexcept : handle_(other.handle_) {
+	other.handle_ = std::coroutine_handle<promise_type>();
+}
+
+inline trading::FeedTask::~FeedTask() {
+	if (handle_) {
+		handle_.destroy();
+	}
+}
+
+inline std::coroutine_handle<trading::FeedTask::promise_type> trading::FeedTask::handle() const {
+	return handle_;
+}
+
+inline trading::FeedScheduler::Readable trading::FeedScheduler::readable(int fd) {
+	Readable awaiter = { *this, fd };
+	return awaiter;
+}
+
+inline trading::FeedScheduler::Yield trading::FeedScheduler::yield() {
+	Yield awaiter = { *this };
+	return awaiter;
+}
+
+#endif /* FEEDSCHEDULER_H_ */
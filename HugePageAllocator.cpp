@@ -0,0 +1,272 @@
+//==========================================================================
+// Name        : HugePageAllocator.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Hugepage- and NUMA-aware allocation for book containers
+//==========================================================================
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "HugePageAllocator.h"
+#include "Log.h"
+
+bool trading::HugePageArena::enabled_ = false;
+std::atomic<bool> trading::HugePageArena::used_(false);
+
+namespace {
+
+using trading::HugePageArena;
+
+enum {
+	smallClasses = HugePageArena::maxSmall / HugePageArena::granularity, // 16, 32, ... 512 bytes
+	minMediumShift = 10,                                                 // 1KB ...
+	maxMediumShift = 20,                                                 // ... 1MB, powers of two
+	mpolPreferred = 1                                                    // MPOL_PREFERRED (linux/mempolicy.h)
+};
+
+// Chunks of one thread, kept until the thread has exited and all their blocks are back
+struct Owner {
+	std::vector<char*> chunks;
+	std::atomic<long int> outstanding; // blocks out, once the owner has exited (before: minus those freed elsewhere)
+};
+
+// Everything a thread allocates from; zero-initialized
+struct ThreadArena {
+	char* next;                                        // bump pointer in the current chunk
+	char* end;
+	void* small[smallClasses];                         // free lists by size class
+	void* medium[maxMediumShift - minMediumShift + 1];
+	Owner* owner;                                      // of the chunks, 0 until the first is mapped
+	long int live;                                     // blocks handed out minus those freed here
+	bool exited;                                       // thread-exit hand-over done; owner is no longer ours
+	bool placed;                                       // node looked up?
+	int node;                                          // NUMA node of the thread, -1 if unknown
+	int bindError;                                     // errno of the last failed mbind, 0 if bound
+	HugePageArena::Backing backing;                    // of the last chunk
+};
+
+thread_local ThreadArena arena;
+
+// Bytes mapped so far, by backing
+std::atomic<unsigned long int> mapped[HugePageArena::backingCount];
+
+void place(ThreadArena& a) {
+	unsigned int cpu = 0;
+	unsigned int node = 0;
+	a.node = (syscall(SYS_getcpu, &cpu, &node, 0) == 0) ? static_cast<int>(node) : -1;
+	a.placed = true;
+}
+
+// Keep [aligned, aligned + bytes) of the 'padded' bytes mapped at 'raw'
+char* trim(char* raw, std::size_t padded, std::size_t bytes, std::size_t alignment) {
+	std::size_t mask = alignment - 1;
+	char* aligned = reinterpret_cast<char*>((reinterpret_cast<std::size_t>(raw) + mask) & ~mask);
+	if (aligned > raw) {
+		munmap(raw, aligned - raw);
+	}
+	if (raw + padded > aligned + bytes) {
+		munmap(aligned + bytes, raw + padded - (aligned + bytes));
+	}
+	return aligned;
+}
+
+// Map 'bytes' (a multiple of pageSize) on an 'alignment' boundary (a multiple of pageSize), as
+// hugepages if possible, and prefer the thread's node
+void* mapRegion(std::size_t bytes, std::size_t alignment, ThreadArena& a) {
+	if (!a.placed) {
+		place(a);
+	}
+
+	// Over-map to align; hugetlb mappings already start on a 2MB boundary
+	std::size_t padded = bytes + alignment - HugePageArena::pageSize;
+	char* raw = static_cast<char*>(mmap(0, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+	void* p;
+	if (raw != MAP_FAILED) {
+		p = trim(raw, padded, bytes, alignment);
+		a.backing = HugePageArena::hugetlb;
+	} else {
+		// No reserved hugepages: align on 2MB at least so transparent hugepages can back it
+		padded = bytes + alignment;
+		raw = static_cast<char*>(mmap(0, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if (raw == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		p = trim(raw, padded, bytes, alignment);
+		a.backing = (madvise(p, bytes, MADV_HUGEPAGE) == 0) ? HugePageArena::transparent : HugePageArena::normal;
+	}
+
+	// Before the first touch, so the pages come from the thread's node
+	a.bindError = ENODEV;
+	if (a.node >= 0 && a.node < 64) {
+		unsigned long int nodemask = 1UL << a.node;
+		a.bindError = (syscall(SYS_mbind, p, bytes, mpolPreferred, &nodemask, 64, 0) == 0) ? 0 : errno;
+	}
+
+	mapped[a.backing] += bytes;
+	return p;
+}
+
+// The Owner of the chunk a small or medium block lives in (stored at the chunk's start)
+Owner* ownerOf(void* p) {
+	std::size_t mask = HugePageArena::chunkSize - 1;
+	return *reinterpret_cast<Owner**>(reinterpret_cast<std::size_t>(p) & ~mask);
+}
+
+void unmapChunks(Owner* owner) {
+	for (std::size_t i = 0; i < owner->chunks.size(); i++) {
+		munmap(owner->chunks[i], HugePageArena::chunkSize);
+	}
+	delete owner;
+}
+
+// A block of an exited or other thread's chunks is back
+void release(Owner* owner) {
+	if (owner->outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) { // only reaches 1 after the owner exited
+		unmapChunks(owner);
+	}
+}
+
+// Hands the thread's chunks over when it exits
+struct Reaper {
+	~Reaper() {
+		ThreadArena& a = arena;
+		if (!a.owner) {
+			return;
+		}
+		Owner* owner = a.owner;
+		a.exited = true; // later frees here (static destructors of the main thread) count as remote
+		if (owner->outstanding.fetch_add(a.live, std::memory_order_acq_rel) + a.live == 0) {
+			unmapChunks(owner);
+		}
+	}
+};
+
+thread_local Reaper reaper;
+
+// Start a new chunk for the calling thread
+void newChunk(ThreadArena& a) {
+	if (!a.owner || a.exited) { // allocating after the hand-over: start over, freed with the process
+		std::memset(&a, 0, sizeof(a));
+		a.owner = new Owner();
+		a.owner->outstanding = 0;
+	}
+	(void)&reaper; // first use in this thread registers its destructor
+
+	a.next = static_cast<char*>(mapRegion(HugePageArena::chunkSize, HugePageArena::chunkSize, a));
+	a.end = a.next + HugePageArena::chunkSize;
+	a.owner->chunks.push_back(a.next);
+	*reinterpret_cast<Owner**>(a.next) = a.owner;
+	a.next += HugePageArena::granularity; // blocks stay 16-byte aligned
+}
+
+std::size_t roundToPages(std::size_t bytes) {
+	return (bytes + HugePageArena::pageSize - 1) & ~static_cast<std::size_t>(HugePageArena::pageSize - 1);
+}
+
+// Free list for a block of 'bytes' and the size actually handed out; 0 for large blocks
+void** freeList(ThreadArena& a, std::size_t& bytes) {
+	if (bytes <= HugePageArena::maxSmall) {
+		std::size_t index = (bytes + HugePageArena::granularity - 1) / HugePageArena::granularity;
+		index = (index > 0) ? index - 1 : 0;
+		bytes = (index + 1) * HugePageArena::granularity;
+		return &a.small[index];
+	}
+	int shift = minMediumShift;
+	while ((static_cast<std::size_t>(1) << shift) < bytes) {
+		shift++;
+	}
+	if (shift > maxMediumShift) {
+		return 0;
+	}
+	bytes = static_cast<std::size_t>(1) << shift;
+	return &a.medium[shift - minMediumShift];
+}
+
+const char* backingName(HugePageArena::Backing backing) {
+	switch (backing) {
+	case HugePageArena::hugetlb:
+		return "2MB pages (MAP_HUGETLB)";
+	case HugePageArena::transparent:
+		return "transparent hugepages (madvise)";
+	default:
+		return "normal pages";
+	}
+}
+
+} // end of anonymous namespace
+
+
+bool trading::HugePageArena::enable() {
+	if (used_.load()) {
+		return false;
+	}
+	enabled_ = true;
+	return true;
+}
+
+void* trading::HugePageArena::allocate(std::size_t bytes) {
+	ThreadArena& a = arena;
+	void** list = freeList(a, bytes);
+	if (!list) {
+		return mapRegion(roundToPages(bytes), pageSize, a);
+	}
+	if (*list && !a.exited) {
+		void* p = *list;
+		*list = *static_cast<void**>(p);
+		a.live++;
+		return p;
+	}
+	if (a.next + bytes > a.end || a.exited) { // the rest of the chunk is abandoned
+		newChunk(a);
+	}
+	void* p = a.next;
+	a.next += bytes;
+	a.live++;
+	return p;
+}
+
+void trading::HugePageArena::deallocate(void* p, std::size_t bytes) {
+	ThreadArena& a = arena;
+	void** list = freeList(a, bytes);
+	if (!list) {
+		munmap(p, roundToPages(bytes));
+		return;
+	}
+	Owner* owner = ownerOf(p);
+	if (owner != a.owner || a.exited) {
+		release(owner);
+		return;
+	}
+	*static_cast<void**>(p) = *list;
+	*list = p;
+	a.live--;
+}
+
+std::string trading::HugePageArena::report() {
+	ThreadArena& a = arena;
+	if (!a.end) {
+		newChunk(a);
+	}
+
+	std::ostringstream os;
+	bool first = true;
+	for (int backing = 0; backing < backingCount; backing++) {
+		if (mapped[backing] > 0) {
+			os << (first ? "" : ", ") << (mapped[backing] >> 20) << " MB in " << backingName(static_cast<Backing>(backing));
+			first = false;
+		}
+	}
+	if (a.bindError == 0) {
+		os << " on NUMA node " << a.node;
+	} else {
+		os << " (NUMA placement unavailable: " << std::strerror(a.bindError) << ")";
+	}
+	return os.str();
+}
@@ -0,0 +1,150 @@
+//============================================================================
+// Name        : HugePageAllocator.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Hugepage- and NUMA-aware allocation for book containers
+//============================================================================
+
+#ifndef HUGEPAGEALLOCATOR_H_
+#define HUGEPAGEALLOCATOR_H_
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <string>
+
+namespace trading {
+
+/**
+ * Huge Page Arena: per-thread chunks of 2MB pages (MAP_HUGETLB, else transparent hugepages via
+ * madvise, else normal pages), placed on the NUMA node of the thread that first allocates, with
+ * a free list per 16-byte size class for container nodes. A thread's chunks are unmapped once it
+ * has exited and every block from them has been freed; a block freed on another thread is only
+ * counted there, never reused. Off unless enable() is called before any book allocates.
+ */
+class HugePageArena {
+public:
+	enum {
+		pageSize = 2 << 20,        // 2MB
+		chunkSize = 16 * pageSize, // mapped at a time
+		granularity = 16,          // size classes ...
+		maxSmall = 512             // ... up to here; larger blocks are mapped individually
+	};
+
+	// How the memory was obtained
+	enum Backing { hugetlb, transparent, normal, backingCount };
+
+	// Route HugePageAllocator through the arenas; false (and no change) if containers
+	// already allocated through the default path
+	static bool enable();
+
+	static bool enabled();
+
+	// Record that a container allocated through the default path
+	static void noteDefaultAllocation();
+
+	// Allocate / free 'bytes' from the calling thread's arena
+	static void* allocate(std::size_t bytes);
+	static void deallocate(void* p, std::size_t bytes);
+
+	// Map the calling thread's first chunk now and describe what was obtained, e.g.
+	// "32 MB in 2MB pages (MAP_HUGETLB) on NUMA node 0"
+	static std::string report();
+
+private:
+	static bool enabled_;
+	static std::atomic<bool> used_; // an allocator fell through to operator new while disabled
+
+	HugePageArena();                      // Don't Implement
+	HugePageArena(HugePageArena const&);  // Don't Implement
+	void operator=(HugePageArena const&); // Don't implement
+};
+
+/**
+ * Huge Page Allocator: standard allocator over HugePageArena, or over operator new while
+ * the arena is disabled
+ */
+template <typename T>
+class HugePageAllocator {
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	template <typename U>
+	struct rebind {
+		typedef HugePageAllocator<U> other;
+	};
+
+	HugePageAllocator() { }
+
+	template <typename U>
+	HugePageAllocator(const HugePageAllocator<U>&) { }
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+
+	pointer allocate(size_type n, const void* = 0);
+	void deallocate(pointer p, size_type n);
+
+	size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+	void construct(pointer p, const T& value) { new (static_cast<void*>(p)) T(value); }
+	void destroy(pointer p) { p->~T(); }
+
+	template <typename U, typename... Args>
+	void construct(U* p, Args&&... args) { new (static_cast<void*>(p)) U(static_cast<Args&&>(args)...); }
+
+	template <typename U>
+	void destroy(U* p) { p->~U(); }
+};
+
+template <typename T, typename U>
+inline bool operator==(const HugePageAllocator<T>&, const HugePageAllocator<U>&) {
+	return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const HugePageAllocator<T>&, const HugePageAllocator<U>&) {
+	return false;
+}
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline bool trading::HugePageArena::enabled() {
+	return enabled_;
+}
+
+inline void trading::HugePageArena::noteDefaultAllocation() {
+	if (!used_.load(std::memory_order_relaxed)) { // read-mostly: no shared stores once set
+		used_.store(true, std::memory_order_relaxed);
+	}
+}
+
+template <typename T>
+inline typename trading::HugePageAllocator<T>::pointer trading::HugePageAllocator<T>::allocate(size_type n, const void*) {
+	if (!HugePageArena::enabled()) {
+		HugePageArena::noteDefaultAllocation();
+		return static_cast<pointer>(::operator new(n * sizeof(T)));
+	}
+	return static_cast<pointer>(HugePageArena::allocate(n * sizeof(T)));
+}
+
+template <typename T>
+inline void trading::HugePageAllocator<T>::deallocate(pointer p, size_type n) {
+	if (!HugePageArena::enabled()) {
+		::operator delete(p);
+		return;
+	}
+	HugePageArena::deallocate(p, n * sizeof(T));
+}
+
+#endif /* HUGEPAGEALLOCATOR_H_ */
@@ -0,0 +1,244 @@
+//==========================================================================
+// Name        : Journal.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Write-ahead journal of the orders applied to a book
+//==========================================================================
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+#include "Journal.h"
+#include "Log.h"
+
+namespace {
+
+const uint32_t journalMagic = 0x4e4a424f; // "OBJN"
+const uint32_t journalVersion = 1;
+
+enum {
+	fileHeaderSize = 16 // magic, version, tick scale
+};
+
+// FNV-1a over a record, checksum field excluded
+uint32_t checksum(const char* data, std::size_t size) {
+	uint32_t hash = 2166136261u;
+	for (std::size_t i = 0; i < size; i++) {
+		hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+	}
+	return hash;
+}
+
+template <typename T>
+void put(char* at, const T& value) {
+	std::memcpy(at, &value, sizeof(value));
+}
+
+template <typename T>
+T get(const char* at) {
+	T value;
+	std::memcpy(&value, at, sizeof(value));
+	return value;
+}
+
+} // end of anonymous namespace
+
+
+trading::Journal::Journal(const std::string& path, unsigned long int commitMs, long int fsyncMs)
+	: fd_(-1), commitInterval_(commitMs), fsyncMs_(fsyncMs), failed_(false), queue_(queueSize), stop_(false) {
+
+	unsigned long int records = 0;
+	unsigned long int lastTimestamp = 0;
+	uint64_t length = 0;
+	std::ifstream probe(path.c_str(), std::ios::binary | std::ios::ate);
+	bool existing = probe && probe.tellg() > 0;
+	probe.close();
+	if (existing) {
+		length = scan(path, 0, records, lastTimestamp); // throws if it is not a journal
+	}
+
+	fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd_ < 0 || (existing && ftruncate(fd_, length) != 0)) {
+		FILE_LOG(logERROR) << "Could not open the journal " << path << ": " << std::strerror(errno);
+		if (fd_ >= 0) {
+			close(fd_);
+		}
+		throw BadJournal();
+	}
+	lseek(fd_, 0, SEEK_END);
+
+	if (!existing) {
+		char header[fileHeaderSize];
+		put(header, journalMagic);
+		put(header + 4, journalVersion);
+		put(header + 8, static_cast<uint64_t>(MarketOrder::tickScale));
+		write(std::string(header, sizeof(header)));
+	}
+	FILE_LOG(logDEBUG) << "Journaling to " << path << " after " << records << " earlier records";
+
+	writer_ = std::thread(&Journal::run, this);
+}
+
+trading::Journal::~Journal() {
+	stop_.store(true, std::memory_order_release);
+	writer_.join();
+	close(fd_);
+}
+
+void trading::Journal::append(const MarketOrder& order) {
+	if (order.id.size() > maxIdLength) {
+		FILE_LOG(logERROR) << "Order id too long to journal: " << order.id.size() << " bytes";
+		throw BadJournal();
+	}
+
+	// Reduces carry no side or price: write zeros so that equal feeds give equal journals
+	bool added = (order.type == add);
+	Record encoded;
+	char* record = encoded.header;
+	put(record + 4, static_cast<uint16_t>(order.id.size()));
+	record[6] = added ? 'A' : 'R';
+	record[7] = added ? ((order.side == buy) ? 'B' : 'S') : 0;
+	put(record + 8, static_cast<uint64_t>(order.timestamp));
+	put(record + 16, static_cast<uint64_t>(added ? order.price : 0));
+	put(record + 24, static_cast<uint64_t>(order.size));
+
+	uint32_t hash = checksum(record + 4, recordHeaderSize - 4);
+	for (std::size_t i = 0; i < order.id.size(); i++) { // continue FNV-1a over the id
+		hash = (hash ^ static_cast<unsigned char>(order.id[i])) * 16777619u;
+	}
+	put(record, hash);
+
+	encoded.id = order.id;
+	queue_.push(std::move(encoded));
+}
+
+void trading::Journal::run() {
+	std::string writing;
+	std::chrono::steady_clock::time_point lastCommit = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point lastSync = lastCommit;
+	bool unsynced = false;
+	Record record;
+
+	unsigned int idle = 0;
+	while (true) {
+		bool stopping = stop_.load(std::memory_order_acquire); // before draining: nothing is pushed after it
+
+		bool any = false;
+		while (writing.size() < highWater && queue_.pop(record)) {
+			writing.append(record.header, recordHeaderSize);
+			writing.append(record.id);
+			any = true;
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (!writing.empty() && (stopping || writing.size() >= highWater || now - lastCommit >= commitInterval_)) {
+			write(writing);
+			writing.clear();
+			lastCommit = now;
+			unsynced = true;
+		}
+
+		// Group commit: one sync covers every record written since the last one
+		if (unsynced && fsyncMs_ >= 0 && (stopping || now - lastSync >= std::chrono::milliseconds(fsyncMs_))) {
+			if (fdatasync(fd_) != 0 && !failed_) {
+				FILE_LOG(logERROR) << "Could not sync the journal: " << std::strerror(errno);
+				failed_ = true;
+			}
+			lastSync = now;
+			unsynced = false;
+		}
+
+		if (stopping && writing.empty() && !any) {
+			return;
+		}
+
+		// Spin briefly, then back off while the feed is quiet
+		if (any) {
+			idle = 0;
+		} else if (++idle < 64) {
+			std::this_thread::yield();
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+}
+
+void trading::Journal::write(const std::string& bytes) {
+	std::size_t done = 0;
+	while (done < bytes.size()) {
+		ssize_t n = ::write(fd_, bytes.data() + done, bytes.size() - done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			if (!failed_) {
+				FILE_LOG(logERROR) << "Could not write the journal: " << std::strerror(errno);
+				failed_ = true;
+			}
+			return;
+		}
+		done += n;
+	}
+}
+
+unsigned long int trading::Journal::replay(const std::string& path, OrderBook& book, unsigned long int& lastTimestamp) {
+	unsigned long int records = 0;
+	lastTimestamp = 0;
+	scan(path, &book, records, lastTimestamp);
+	return records;
+}
+
+uint64_t trading::Journal::scan(const std::string& path, OrderBook* book, unsigned long int& records, unsigned long int& lastTimestamp) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	char header[fileHeaderSize];
+	if (!in.read(header, sizeof(header)) || get<uint32_t>(header) != journalMagic ||
+			get<uint32_t>(header + 4) != journalVersion || get<uint64_t>(header + 8) != MarketOrder::tickScale) {
+		FILE_LOG(logERROR) << path << " is not a journal of this Pricer";
+		throw BadJournal();
+	}
+
+	uint64_t length = fileHeaderSize;
+	char record[recordHeaderSize];
+	std::string id;
+	MarketOrder order;
+	OrderBook::Impact impact;
+	while (in.read(record, sizeof(record))) {
+		id.resize(get<uint16_t>(record + 4));
+		if (!id.empty() && !in.read(&id[0], id.size())) {
+			break;
+		}
+		uint32_t hash = checksum(record + 4, recordHeaderSize - 4);
+		for (std::size_t i = 0; i < id.size(); i++) {
+			hash = (hash ^ static_cast<unsigned char>(id[i])) * 16777619u;
+		}
+		if (hash != get<uint32_t>(record)) {
+			break;
+		}
+
+		if (book) {
+			order.type = (record[6] == 'A') ? add : reduce;
+			order.side = (record[7] == 'B') ? buy : sell;
+			order.timestamp = get<uint64_t>(record + 8);
+			order.price = get<uint64_t>(record + 16);
+			order.size = get<uint64_t>(record + 24);
+			order.id = id;
+			if (book->processOrder(order, impact) != success) {
+				FILE_LOG(logERROR) << "Journal record rejected by the book: " << order.toString();
+			}
+		}
+		lastTimestamp = get<uint64_t>(record + 8);
+		records++;
+		length += recordHeaderSize + id.size();
+	}
+
+	in.clear();
+	in.seekg(0, std::ios::end);
+	if (static_cast<uint64_t>(in.tellg()) > length) {
+		FILE_LOG(logERROR) << "Journal " << path << " has a torn or corrupt tail at byte " << length << "; ignoring the rest";
+	}
+	return length;
+}
@@ -0,0 +1,90 @@
+//============================================================================
+// Name        : Journal.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Write-ahead journal of the orders applied to a book
+//============================================================================
+
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+#include "Exceptions.h"
+#include "MarketOrder.h"
+#include "OrderBook.h"
+#include "SpscQueue.h"
+
+namespace trading {
+
+/**
+ * Journal: append-only binary log of every order the book accepted. The book thread only
+ * encodes each record and hands it over a lock-free queue; a writer thread collects them and
+ * writes once per commit interval (group commit), calling fdatasync at most once per fsync
+ * interval.
+ *
+ * File: 16-byte header ("OBJN", version, tick scale), then records of a 32-byte fixed part
+ * (checksum, id length, type, side, timestamp, price, size) followed by the id. A torn or
+ * corrupt tail, e.g. after a crash mid-write, ends the journal.
+ */
+class Journal {
+public:
+	enum {
+		defaultCommitMs = 1,    // group commit interval
+		highWater = 1 << 20,    // write early once this many bytes are collected
+		maxIdLength = 65535,    // ids are stored with a 16-bit length
+		queueSize = 1 << 16     // records in flight to the writer; append waits when full
+	};
+
+	// Append to 'path' (created if missing, torn tail cut off); fsyncMs < 0 leaves syncing
+	// to the OS, 0 syncs every commit. Throws BadJournal.
+	Journal(const std::string& path, unsigned long int commitMs, long int fsyncMs);
+
+	// Writes and syncs whatever is pending
+	~Journal();
+
+	// Record an order the book accepted (book thread); throws BadJournal if its id is
+	// longer than maxIdLength, so callers check that before applying the order
+	void append(const MarketOrder& order);
+
+	// Replay the journal at 'path' into 'book'; returns the number of orders applied and sets
+	// 'lastTimestamp'. Throws BadJournal if the file is missing or is not a journal.
+	static unsigned long int replay(const std::string& path, OrderBook& book, unsigned long int& lastTimestamp);
+
+private:
+	enum { recordHeaderSize = 32 }; // checksum, id length, type, side, timestamp, price, size
+
+	// One encoded record on its way to the writer
+	struct Record {
+		char header[recordHeaderSize];
+		std::string id;
+	};
+
+	// Read every intact record (applying them to 'book' if given); returns the journal's valid length
+	static uint64_t scan(const std::string& path, OrderBook* book, unsigned long int& records, unsigned long int& lastTimestamp);
+
+	// Writer thread
+	void run();
+	void write(const std::string& bytes);
+
+	int fd_;
+	std::chrono::milliseconds commitInterval_;
+	long int fsyncMs_;
+	bool failed_; // a write failed; logged once
+
+	SpscQueue<Record> queue_;
+	std::atomic<bool> stop_;
+	std::thread writer_;
+
+	Journal(Journal const&);         // Don't Implement
+	void operator=(Journal const&);  // Don't implement
+};
+
+} // end of namespace
+
+#endif /* JOURNAL_H_ */
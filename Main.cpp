@@ -7,20 +7,182 @@
 //============================================================================
 
 #include <iostream>
-#include <iomanip>  // setprecision
+#include <iomanip>  // setiosflags, setprecision
+#include <algorithm> // max
+#include <chrono>
 #include <cassert>
+#include <cstdlib>  // atol
+#include <cstring>  // strcmp
+#include <memory>
 #include <string>   // getline
+#include <thread>   // hardware_concurrency
+#include <vector>
 #include <typeinfo>
+#include <poll.h>
 
+#include "BatchRunner.h"
+#include "FeedIndex.h"
+#include "FeedReceiver.h"
+#include "FeedScheduler.h"
+#include "HugePageAllocator.h"
+#include "Journal.h"
 #include "OrderBook.h"
 #include "Log.h"
 #include "MarketDataProvider.h"
 #include "MarketOrder.h"
-#include "Parser.h"
 #include "Exceptions.h"
+#include "PricePublisher.h"
+#include "PricingSession.h"
+#include "QueryServer.h"
+#include "ShadowVerifier.h"
 #include "Utils.h"
 
 
+namespace {
+
+// When reportStats is called
+enum StatsCall {
+	perMessage, // after each message
+	idle,       // after waiting for the feed, see statsWaitMs
+	atEnd       // at the end, to report whatever the interval
+};
+
+std::chrono::steady_clock::time_point statsLast = std::chrono::steady_clock::now(); // of the previous report
+
+// Print the book's statistics to standard error every 'interval' seconds (0 = never), with
+// rates since the previous report
+void reportStats(unsigned long int interval, StatsCall call = perMessage) {
+	static unsigned long int calls = 0;
+	static trading::OrderBook::Stats previous = trading::OrderBook::Stats();
+
+	if (interval == 0 || (call == perMessage && ++calls % 256 != 0)) { // the clock is read every 256 messages
+		return;
+	}
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(now - statsLast).count();
+	if (call != atEnd && seconds < interval) {
+		return;
+	}
+
+	trading::OrderBook::Stats stats = trading::OrderBook::getInstance().stats();
+	double rate = (seconds > 0) ? 1 / seconds : 0;
+	double mb = 1.0 / (1 << 20);
+	std::cerr << std::fixed << std::setprecision(2) <<
+			"stats: orders " << stats.bidOrders << "/" << stats.askOrders <<
+			" (peak " << stats.peakBidOrders << "/" << stats.peakAskOrders << ")" <<
+			", levels " << stats.bidLevels << "/" << stats.askLevels <<
+			" (peak " << stats.peakBidLevels << "/" << stats.peakAskLevels << ")" <<
+			", MB maps " << (stats.bidsMapBytes + stats.asksMapBytes) * mb <<
+			" hashes " << (stats.bidsHashBytes + stats.asksHashBytes) * mb <<
+			" ladders " << stats.laddersBytes * mb <<
+			", load " << stats.bidsLoadFactor << "/" << stats.asksLoadFactor <<
+			", rehashes " << stats.rehashes <<
+			", per second: adds " << (stats.adds - previous.adds) * rate <<
+			" reduces " << (stats.reduces - previous.reduces) * rate <<
+			" removes " << (stats.removes - previous.removes) * rate <<
+			" errors " << (stats.errors - previous.errors) * rate << std::endl;
+
+	previous = stats;
+	statsLast = now;
+}
+
+// How long a wait for the feed may block before the next report is due (-1 = no reports)
+int statsWaitMs(unsigned long int interval) {
+	if (interval == 0) {
+		return -1;
+	}
+	double left = interval - std::chrono::duration<double>(std::chrono::steady_clock::now() - statsLast).count();
+	return (left > 0) ? static_cast<int>(left * 1000) + 1 : 0;
+}
+
+// "Receive" new message; returns false when the market data file is exhausted.
+// With a query server, queries are answered every few messages and, if the server watches
+// standard input ('stdinWatched'), while it is idle. Statistics are reported while it is idle too.
+bool receiveMessage(bool useFileForMarketFeed, std::string& msg, trading::QueryServer* server, bool stdinWatched,
+		unsigned long int statsInterval) {
+	if (server) {
+		server->tick();
+	}
+	if (useFileForMarketFeed) {
+		if (!trading::MarketDataProvider::getInstance().hasNextMessage()) {
+			return false;
+		}
+		msg = trading::MarketDataProvider::getInstance().nextMessage();
+		std::cout << msg << std::endl;
+		return true;
+	}
+	if (server && stdinWatched) {
+		while (std::cin.rdbuf()->in_avail() <= 0 && !server->poll(statsWaitMs(statsInterval))) {
+			reportStats(statsInterval, idle);
+		}
+	} else if (statsInterval > 0) {
+		struct pollfd input = { 0, POLLIN, 0 };
+		while (std::cin.rdbuf()->in_avail() <= 0 && ::poll(&input, 1, statsWaitMs(statsInterval)) == 0) {
+			reportStats(statsInterval, idle);
+		}
+	}
+	return static_cast<bool>(std::getline(std::cin, msg));
+}
+
+// Conflation: does the current batch continue past the message stamped 'timestamp'?
+// From a file, a batch is a run of messages with the same timestamp; from standard
+// input, it is whatever has already been buffered.
+bool batchContinues(bool useFileForMarketFeed, unsigned long int timestamp) {
+	if (useFileForMarketFeed) {
+		return trading::MarketDataProvider::getInstance().hasNextMessage() &&
+				static_cast<unsigned long int>(std::atol(trading::MarketDataProvider::getInstance().peekMessage().c_str())) == timestamp;
+	}
+	return std::cin.rdbuf()->in_avail() > 0;
+}
+
+// Seek into the feed with its sidecar index: restore the latest checkpoint at or before
+// 'timestamp' into the book and load only the messages after it
+unsigned long int seekMarketDataFile(const std::string& filename, unsigned long int timestamp, unsigned long int interval) {
+	trading::FeedIndex index = trading::FeedIndex::open(filename, interval);
+	const trading::FeedIndex::Checkpoint* checkpoint = index.checkpointAt(timestamp);
+	if (!checkpoint) {
+		trading::MarketDataProvider::getInstance().readMarketDataFile(filename);
+		return 0;
+	}
+
+	FILE_LOG(logDEBUG) << "Resuming from the checkpoint at " << checkpoint->timestamp << " (offset " << checkpoint->offset << ")";
+	try {
+		index.restore(*checkpoint, trading::OrderBook::getInstance()); // leaves the book empty if it throws
+	} catch (const trading::BadFeedIndex&) {
+		FILE_LOG(logERROR) << "Error reading the feed index; replaying the whole feed";
+		trading::MarketDataProvider::getInstance().readMarketDataFile(filename);
+		return 0;
+	}
+	trading::MarketDataProvider::getInstance().readMarketDataFile(filename, checkpoint->offset);
+	return checkpoint->timestamp;
+}
+
+// Print the latest results another Pricer published with --shm
+int printSharedPrices(const std::string& name) {
+	trading::PriceSnapshot snapshot;
+	try {
+		trading::PricePublisher::Reader reader(name);
+		if (!reader.read(snapshot)) {
+			std::cout << "Nothing published yet" << std::endl;
+			return 0;
+		}
+	} catch (const trading::BadSharedMemory&) {
+		FILE_LOG(logERROR) << "No price segment named " << name;
+		return 1;
+	}
+
+	double scale = static_cast<double>(snapshot.tickScale);
+	std::cout << std::setprecision(2) << "seq " << snapshot.sequence << " at " << snapshot.timestamp <<
+			" size " << snapshot.targetSize << std::endl;
+	std::cout << "B " << snapshot.buyAmount << " S " << snapshot.sellAmount << std::endl;
+	std::cout << "bid " << snapshot.bestBidPrice / scale << " x " << snapshot.bestBidSize <<
+			" ask " << snapshot.bestAskPrice / scale << " x " << snapshot.bestAskSize << std::endl;
+	return 0;
+}
+
+} // end of anonymous namespace
+
+
 int main(int argc, char* argv[]) {
 	try {
 		std::cout << std::setiosflags(std::ios::fixed); // to show amounts as XXXX.XX
@@ -29,136 +191,304 @@ int main(int argc, char* argv[]) {
 
 
 		// Process arguments:
-		// Arguments should be either "./Pricer 200" or "./Pricer 200 feed.txt"
+		// Arguments should be either "./Pricer 200" or "./Pricer 200 feed.txt",
+		// optionally preceded by "--conflate" (and, with a file, "--from <time>"), or
+		// "./Pricer --batch [--threads N] 200 feed1.txt feed2.txt ...", or
+		// "./Pricer --multiplex 200 feed1.txt feed2.fifo ..."
+
+		bool conflate = false;
+		bool batch = false;
+		bool multiplex = false;
+		bool seek = false;
+		unsigned long int fromTimestamp = 0;
+		unsigned long int indexInterval = trading::FeedIndex::defaultInterval;
+		unsigned long int resumedAt = 0;
+		std::string shmName;
+		std::string queryPath;
+		std::vector<std::string> listenSpecs;
+		std::string journalPath;
+		std::string recoverPath;
+		unsigned long int journalCommitMs = trading::Journal::defaultCommitMs;
+		long int journalFsyncMs = -1;
+		unsigned long int statsInterval = 0;
+		unsigned long int verifyEvery = 0;
+		bool vectorizedDepth = true;
+		std::size_t threads = std::thread::hardware_concurrency();
+		std::vector<char*> args;
+		for (int i = 1; i < argc; i++) {
+			if (std::strcmp(argv[i], "--conflate") == 0) {
+				conflate = true;
+			} else if (std::strcmp(argv[i], "--batch") == 0) {
+				batch = true;
+			} else if (std::strcmp(argv[i], "--multiplex") == 0) {
+				multiplex = true;
+			} else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+				threads = std::atol(argv[++i]);
+			} else if (std::strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+				seek = true;
+				fromTimestamp = trading::parseTimeOfDay(argv[++i]);
+			} else if (std::strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+				shmName = argv[++i];
+			} else if (std::strcmp(argv[i], "--hugepages") == 0) {
+#ifdef PRICER_HUGEPAGES
+				if (!trading::HugePageArena::enable()) {
+					FILE_LOG(logERROR) << "Too late to switch the books to hugepages";
+				}
+#else
+				FILE_LOG(logERROR) << "--hugepages needs a Pricer built with 'make hugepages'";
+				abort();
+#endif
+			} else if (std::strcmp(argv[i], "--journal") == 0 && i + 1 < argc) {
+				journalPath = argv[++i];
+			} else if (std::strcmp(argv[i], "--journal-commit") == 0 && i + 1 < argc) {
+				journalCommitMs = std::max(std::atol(argv[++i]), 1L);
+			} else if (std::strcmp(argv[i], "--journal-fsync") == 0 && i + 1 < argc) {
+				journalFsyncMs = std::atol(argv[++i]);
+			} else if (std::strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+				statsInterval = std::max(std::atol(argv[++i]), 1L);
+			} else if (std::strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+				verifyEvery = std::max(std::atol(argv[++i]), 1L);
+			} else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+				vectorizedDepth = (std::strcmp(argv[++i], "walk") != 0);
+			} else if (std::strcmp(argv[i], "--recover") == 0 && i + 1 < argc) {
+				recoverPath = argv[++i];
+			} else if (std::strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+				listenSpecs.push_back(argv[++i]);
+			} else if (std::strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+				queryPath = argv[++i];
+			} else if (std::strcmp(argv[i], "--shm-read") == 0 && i + 1 < argc) {
+				return printSharedPrices(argv[++i]);
+			} else if (std::strcmp(argv[i], "--index-interval") == 0 && i + 1 < argc) {
+				indexInterval = std::max(std::atol(argv[++i]), 1L);
+			} else {
+				args.push_back(argv[i]);
+			}
+		}
 
 		unsigned long int targetSize;
 		bool useFileForMarketFeed;
 
-		switch (argc) {
-		case 2:
-			targetSize = std::atol(argv[1]);
+		switch ((batch || multiplex) ? (args.size() >= 2 ? 3 : 0) : args.size()) {
+		case 1:
+			targetSize = std::atol(args[0]);
 			if (targetSize < 1) {
 				FILE_LOG(logERROR) << "Expected a positive number greater than or equal to 1";
 				abort();
 			}
 			useFileForMarketFeed = false;
+			if (seek) {
+				FILE_LOG(logERROR) << "--from needs a feed file: standard input and sockets cannot be seeked";
+				abort();
+			}
 			break;
-		case 3:
-			targetSize = std::atol(argv[1]);
+		case 2:
+			targetSize = std::atol(args[0]);
 			if (targetSize < 1) {
 				FILE_LOG(logERROR) << "Expected a positive number greater than or equal to 1";
 				abort();
 			}
 			useFileForMarketFeed = true;
 			try {
-				trading::MarketDataProvider::getInstance().readMarketDataFile(argv[2]);
+				if (seek) {
+					resumedAt = seekMarketDataFile(args[1], fromTimestamp, indexInterval);
+				} else {
+					trading::MarketDataProvider::getInstance().readMarketDataFile(args[1]);
+				}
 			} catch (const trading::BadMarketDataFile& e) {
 				FILE_LOG(logERROR) << "Error opening the market data file";
 				abort();
 			}
 			break;
+		case 3: // batch of feed files, or feeds to multiplex
+			targetSize = std::atol(args[0]);
+			if (targetSize < 1) {
+				FILE_LOG(logERROR) << "Expected a positive number greater than or equal to 1";
+				abort();
+			}
+			useFileForMarketFeed = true;
+			break;
 		default:
-			FILE_LOG(logERROR) << "Error with program arguments. There are two ways to start this program:";
+			FILE_LOG(logERROR) << "Error with program arguments. There are three ways to start this program:";
 			FILE_LOG(logERROR) << "./Pricer 200             // 200 is the target size of market order";
 			FILE_LOG(logERROR) << "./Pricer 200 feed.txt    // use feed.txt instead of standard input";
+			FILE_LOG(logERROR) << "./Pricer --batch [--threads N] 200 day1.txt day2.txt ...  // price many feeds concurrently";
+			FILE_LOG(logERROR) << "./Pricer --multiplex 200 a.txt b.fifo - ...  // price many live feeds on one thread";
+			FILE_LOG(logERROR) << "Add --conflate to reprice once per batch of messages instead of once per message";
+			FILE_LOG(logERROR) << "Add --shm /name to publish costs and best bid/offer to shared memory; --shm-read /name prints them";
+			FILE_LOG(logERROR) << "Add --journal day.jnl [--journal-commit MS] [--journal-fsync MS] to log every accepted order";
+			FILE_LOG(logERROR) << "Add --recover day.jnl to rebuild the book from a journal before reading the feed";
+			FILE_LOG(logERROR) << "Add --stats N to print book statistics to standard error every N seconds (not with --batch or --multiplex)";
+			FILE_LOG(logERROR) << "Add --engine vector|walk to price depth with the vectorized level walk (default) or order by order";
+			FILE_LOG(logERROR) << "Add --verify N to check every Nth message against the reference book on another thread (1 = all)";
+			FILE_LOG(logERROR) << "Add --hugepages to keep the books in 2MB pages on the local NUMA node (build with 'make hugepages')";
+			FILE_LOG(logERROR) << "Add --listen tcp:9000 or udp:9001 (repeatable) to take the feed from sockets instead of standard input";
+			FILE_LOG(logERROR) << "Add --query /path/to/socket to answer batched cost-to-trade queries (see QueryServer.h)";
+			FILE_LOG(logERROR) << "Add --from 14:30 (or ms since midnight) with a feed file to start there using feed.txt.idx";
 			abort();
 		}
 
 		assert(targetSize >= 1);
-		FILE_LOG(logDEBUG) << "target-size = " << targetSize;
-
-		// For the the market order
-		double newAmount = 0;
-		double cachedBuyAmount = 0;
-		double cachedSellAmount = 0;
+		if (trading::HugePageArena::enabled()) {
+			std::cerr << "Hugepages: " << trading::HugePageArena::report() << std::endl;
+		}
+		FILE_LOG(logDEBUG) << "target-size = " << targetSize << (conflate ? " (conflated)" : "");
 
-		// Main loop
-		while (true) {
+		if ((batch || multiplex) && (statsInterval > 0 || verifyEvery > 0)) {
+			FILE_LOG(logERROR) << "--stats and --verify follow the one book of a single feed, not --batch or --multiplex";
+			abort();
+		}
+		if (batch) {
+			trading::BatchRunner runner(targetSize, conflate, threads > 0 ? threads : 1);
+			for (std::size_t i = 1; i < args.size(); i++) {
+				runner.add(args[i]);
+			}
+			runner.run();
+			runner.report(std::cout, std::cerr);
+			return 0;
+		}
 
-			// Infinite loop if using standard input; break loop on EOF if using a market data file
-			if (useFileForMarketFeed && !trading::MarketDataProvider::getInstance().hasNextMessage()) {
-				break;
+		if (multiplex) {
+			trading::FeedMultiplexer multiplexer(targetSize, conflate, std::cout);
+			for (std::size_t i = 1; i < args.size(); i++) {
+				multiplexer.add(args[i]);
 			}
+			multiplexer.run();
+			multiplexer.report(std::cerr);
+			return 0;
+		}
 
-			// "Receive" new message
-			std::string msg;
-			if (useFileForMarketFeed) {
-				msg = trading::MarketDataProvider::getInstance().nextMessage();
-				std::cout << msg << std::endl;
-			} else {
-				std::getline(std::cin, msg);
-				// std::cout << msg << std::endl;
+		std::unique_ptr<trading::FeedReceiver> receiver;
+		if (!listenSpecs.empty() && !useFileForMarketFeed) {
+			receiver.reset(new trading::FeedReceiver());
+			for (std::size_t i = 0; i < listenSpecs.size(); i++) {
+				receiver->listen(listenSpecs[i]);
 			}
+		} else if ((conflate || !queryPath.empty() || statsInterval > 0) && !useFileForMarketFeed) {
+			std::ios::sync_with_stdio(false); // otherwise std::cin never reports buffered input
+		}
 
+		trading::PricingSession session(trading::OrderBook::getInstance(), targetSize, std::cout);
+		trading::OrderBook::getInstance().setVectorizedDepth(vectorizedDepth);
 
-			// Parse message
-			trading::MarketOrder order;
-			unsigned long int prevTimestamp = 0;
-			try {
-				order = trading::Parser::parse(msg);
+		std::unique_ptr<trading::PricePublisher> publisher;
+		if (!shmName.empty()) {
+			publisher.reset(new trading::PricePublisher(shmName));
+			session.setPublisher(publisher.get());
+		}
 
-				if (order.timestamp < prevTimestamp) { // out of order messages
-					throw trading::OutOfOrder(); // technically, this throw should be elsewhere in a real system
-				}
+		// Recovery: rebuild the book from the journal, then show the costs as of its last order
+		if (seek && (!recoverPath.empty() || !journalPath.empty())) {
+			FILE_LOG(logERROR) << "--from restores the book from a checkpoint, which neither --recover nor --journal can follow";
+			abort();
+		}
+		if (!recoverPath.empty()) {
+			unsigned long int recoveredAt = 0;
+			unsigned long int recovered = trading::Journal::replay(recoverPath, trading::OrderBook::getInstance(), recoveredAt);
+			FILE_LOG(logDEBUG) << "Recovered " << recovered << " orders up to " << recoveredAt;
+			session.resumeAt(recoveredAt);
+			session.reprice();
+			session.publish();
+		}
 
-			} catch (const trading::ParseException&) {
-				FILE_LOG(logERROR) << "Skipping this message due to parsing errors: " << msg;
-				continue;
-			}
+		std::unique_ptr<trading::Journal> journal;
+		if (!journalPath.empty()) {
+			journal.reset(new trading::Journal(journalPath, journalCommitMs, journalFsyncMs));
+			session.setJournal(journal.get());
+		}
 
+		// Verification: the reference book starts from whatever was restored above
+		std::unique_ptr<trading::ShadowVerifier> verifier;
+		if (verifyEvery > 0) {
+			verifier.reset(new trading::ShadowVerifier(trading::OrderBook::getInstance(), targetSize, verifyEvery));
+			session.setVerifier(verifier.get());
+		}
 
-			// Submit the message to the order book
-			try {
-				trading::OrderBook::getInstance().processOrder(order);
-			} catch (const trading::OrderBookException&) {
-				FILE_LOG(logERROR) << "Error in order book when submitting the following order: " << order.toString();
-				continue;
+		std::unique_ptr<trading::QueryServer> server;
+		bool stdinWatched = false; // standard input redirected from a file cannot be
+		if (!queryPath.empty()) {
+			server.reset(new trading::QueryServer(queryPath, session));
+			if (receiver) {
+				server->watch(receiver->fd()); // wake up for the feed sockets too
+			} else if (!useFileForMarketFeed) {
+				stdinWatched = server->watch(0); // wake up for standard input too
 			}
+		}
 
-			std::string result;
-			try {
-				result = trading::OrderBook::printBook();
-				FILE_LOG(logDEBUG) << "Result: " << result;
-			} catch (const trading::OrderBookException&) {
-				FILE_LOG(logERROR) << "Error while printing book";
-				continue;
+		// Seeking: replay silently up to the requested time, then show the costs as of then
+		if (seek && useFileForMarketFeed) {
+			session.resumeAt(resumedAt);
+			while (trading::MarketDataProvider::getInstance().hasNextMessage() &&
+					static_cast<unsigned long int>(std::atol(trading::MarketDataProvider::getInstance().peekMessage().c_str())) <= fromTimestamp) {
+				session.apply(trading::MarketDataProvider::getInstance().nextMessage());
 			}
+			session.resumeAt(session.lastTimestamp());
+			session.reprice();
+			session.publish();
+		}
 
+		// Socket feeds: everything received in one round is a batch
+		std::vector<std::string> received;
+		while (receiver && receiver->active()) {
+			if (server && !receiver->backlogged()) {
+				while (!server->poll(statsWaitMs(statsInterval))) {
+					reportStats(statsInterval, idle);
+				}
+			}
+			received.clear();
+			receiver->receive(received, server ? 0 : statsWaitMs(statsInterval));
+			if (received.empty()) {
+				reportStats(statsInterval, idle);
+			}
 
-			// Pretend to execute a market order
-			try {
+			for (std::size_t i = 0; i < received.size(); i++) {
+				session.apply(received[i]);
+				reportStats(statsInterval);
 
-				// buy at market
-				newAmount = trading::OrderBook::getInstance().pretendExecuteMarketOrder(trading::buy,targetSize);
-				if (newAmount != cachedBuyAmount) { // only display if newAmount changes
-					cachedBuyAmount = newAmount;
-					if (newAmount > 0) {
-						std::cout << order.timestamp << " B " << std::setprecision(2) << newAmount << std::endl;
-					} else { // newAmount = 0;
-						std::cout << order.timestamp << " B NA" << std::endl;
-					}
+				// In conflation mode, keep applying until the batch is drained
+				if (conflate && i + 1 < received.size()) {
+					continue;
 				}
 
-
-				// sell at market
-				newAmount = trading::OrderBook::getInstance().pretendExecuteMarketOrder(trading::sell,targetSize);
-				if (newAmount != cachedSellAmount) { // only display if newAmount changes
-					cachedSellAmount = newAmount;
-					if (newAmount > 0) {
-						std::cout << order.timestamp << " S " << std::setprecision(2) << newAmount << std::endl;
-					} else { // newAmount = 0;
-						std::cout << order.timestamp << " S NA" << std::endl;
-					}
+				if (session.repriceDue()) {
+					session.reprice();
+				}
+				session.publish();
+				if (server) {
+					server->tick();
 				}
+			}
+		}
+
+		// Main loop
+		std::string msg;
+		while (!receiver && receiveMessage(useFileForMarketFeed, msg, server.get(), stdinWatched, statsInterval)) {
 
-			} catch (const trading::OrderBookException&) {
-				FILE_LOG(logERROR) << "Error while pretending to execute a market order " << order.toString();
+			session.apply(msg);
+			reportStats(statsInterval);
+
+			// In conflation mode, keep applying until the batch is drained
+			if (conflate && batchContinues(useFileForMarketFeed, session.lastTimestamp())) {
 				continue;
 			}
 
+			if (session.repriceDue()) { // something that could change the fill
+				session.reprice();
+			}
+			session.publish();
 		}
 
 		// Done
+		reportStats(statsInterval, atEnd);
+		if (verifier) {
+			std::cerr << verifier->finish() << std::endl;
+		}
+		if (session.counters().errors() > 0) {
+			FILE_LOG(logERROR) << session.errorSummary();
+		}
+		if (server) {
+			std::cerr << "Answered " << server->answered() << " queries, mean latency " <<
+					server->meanLatencyNs() << " ns, worst " << server->maxLatencyNs() << " ns" << std::endl;
+		}
 		FILE_LOG(logDEBUG) << "Simulator is stopped.";
 
 	} catch (const trading::Exception& e) { // exception catch-all
@@ -166,4 +496,3 @@ int main(int argc, char* argv[]) {
 	}
 	return 0;
 }
-
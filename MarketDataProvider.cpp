@@ -11,6 +11,7 @@
 #include <iterator>
 #include <algorithm> // copy
 
+#include "DecompressingReader.h"
 #include "Log.h"
 #include "MarketDataProvider.h"
 #include "Utils.h"
@@ -20,11 +21,39 @@ std::vector<std::string> trading::MarketDataProvider::messages_ = std::vector<st
 std::vector<std::string>::iterator trading::MarketDataProvider::cur_ = trading::MarketDataProvider::messages_.begin();
 std::string trading::MarketDataProvider::filename_ = std::string();
 
+std::unique_ptr<trading::DecompressingReader> trading::MarketDataProvider::stream_;
+std::string trading::MarketDataProvider::current_ = std::string();
+std::string trading::MarketDataProvider::lookahead_ = std::string();
+bool trading::MarketDataProvider::hasLookahead_ = false;
+
 void trading::MarketDataProvider::readMarketDataFile(const std::string& filename) {
+	readMarketDataFile(filename, 0);
+}
+
+void trading::MarketDataProvider::readMarketDataFile(const std::string& filename, const std::streamoff& offset) {
 	messages_.clear();
+	stream_.reset();
 	filename_ = filename;
-	messages_ = readFile2Vector(filename_);
+
+	if (DecompressingReader::detect(filename_) != DecompressingReader::plain) {
+		if (offset != 0) { // offsets index the uncompressed text
+			throw BadMarketDataFile();
+		}
+		stream_.reset(new DecompressingReader(filename_));
+		hasLookahead_ = stream_->getline(lookahead_);
+		cur_ = messages_.begin();
+		FILE_LOG(logDEBUG) << "MarketDataProvider is streaming compressed file " << filename_;
+		return;
+	}
+
+	messages_ = readFile2Vector(filename_, offset);
 	FILE_LOG(logDEBUG) << "MarketDataProvider is initialized with " << messages_.size() << " messages";
 	// std::copy(messages.begin(), messages.end(), std::ostream_iterator<std::string>(std::cout,"\n"));
 	cur_ = trading::MarketDataProvider::messages_.begin();
 }
+
+const std::string& trading::MarketDataProvider::advanceStream() {
+	current_.swap(lookahead_);
+	hasLookahead_ = stream_->getline(lookahead_);
+	return current_;
+}
@@ -9,12 +9,16 @@
 #ifndef MARKETDATAPROVIDER_H_
 #define MARKETDATAPROVIDER_H_
 
+#include <ios>
+#include <memory>
 #include <string>
 #include <vector>
 #include "Exceptions.h"
 
 namespace trading {
 
+class DecompressingReader;
+
 /**
  * Market Data Provider as Meyers' Singleton
  */
@@ -24,20 +28,35 @@ public:
 	// Singleton
 	static MarketDataProvider& getInstance();
 
-	// Read trades from market data file
+	// Read trades from market data file; gzip and zstd files are decompressed as they are read
 	static void readMarketDataFile(const std::string& filename);
 
+	// Read trades from market data file, starting at byte 'offset' (see FeedIndex; uncompressed files only)
+	static void readMarketDataFile(const std::string& filename, const std::streamoff& offset);
+
 	// Not EOF?
 	static bool hasNextMessage();
 
 	// Get next message from the market data file
 	static const std::string& nextMessage();
 
+	// Look at the next message without consuming it
+	static const std::string& peekMessage();
+
 private:
 	static std::string filename_;
 	static std::vector<std::string> messages_;
 	static std::vector<std::string>::iterator cur_;
 
+	// Compressed files are streamed instead of loaded into messages_
+	static std::unique_ptr<DecompressingReader> stream_;
+	static std::string current_;   // last message returned
+	static std::string lookahead_; // next message, if hasLookahead_
+	static bool hasLookahead_;
+
+	// Move the lookahead to current_ and read the next one
+	static const std::string& advanceStream();
+
 // Singleton stuff
 private:
 	MarketDataProvider() { }
@@ -57,12 +76,17 @@ inline trading::MarketDataProvider& trading::MarketDataProvider::getInstance() {
 
 
 inline bool trading::MarketDataProvider::hasNextMessage() {
+	if (stream_) {
+		return hasLookahead_;
+	}
 	return (cur_ != messages_.end());
 }
 
 
 inline const std::string& trading::MarketDataProvider::nextMessage() {
-	if (hasNextMessage()) {
+	if (stream_ && hasLookahead_) {
+		return advanceStream();
+	} else if (!stream_ && hasNextMessage()) {
 		std::vector<std::string>::iterator saved = cur_;
 		cur_++;
 		//std::cout << "saved = " << *saved << std::endl;
@@ -72,4 +96,15 @@ inline const std::string& trading::MarketDataProvider::nextMessage() {
 	}
 }
 
+
+inline const std::string& trading::MarketDataProvider::peekMessage() {
+	if (stream_ && hasLookahead_) {
+		return lookahead_;
+	} else if (!stream_ && hasNextMessage()) {
+		return *cur_;
+	} else {
+		throw(trading::OutOfBounds());
+	}
+}
+
 #endif /* MARKETDATAPROVIDER_H_ */
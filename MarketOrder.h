@@ -19,36 +19,44 @@ namespace trading {
 enum OrderType {add, reduce};
 enum OrderSide {buy, sell};
 
-// Market Order
-struct MarketOrder {
+// Market Order, parameterized on price, size and id types and on the tick scale
+// (price units per currency unit, e.g. 100 for prices in cents)
+template <typename PriceT, typename SizeT, typename IdT, unsigned long int TickScale>
+struct BasicMarketOrder {
 	std::string toString() const;
 
 	// We'll use these typedefs in the OrderBook class
-	typedef unsigned long int Price; // limit price (in cents)
-	typedef unsigned long int Size;  // Order size
-	typedef std::string Id;          // unique order ID
+	typedef PriceT Price; // limit price (in ticks)
+	typedef SizeT Size;   // Order size
+	typedef IdT Id;       // unique order ID
+
+	static const unsigned long int tickScale = TickScale;
 
 
 	OrderType type;
 	unsigned long int timestamp;  // milliseconds since midnight
 	Id id;                        // unique ID
 	OrderSide side;               // order side
-	Price price;                  // limit price (in cents, to avoid rounding issues)
+	Price price;                  // limit price (in ticks, to avoid rounding issues)
 	Size size;       			  // order size (# shares)
 
 };
 
+// The Pricer's order: prices in cents, string ids
+typedef BasicMarketOrder<unsigned long int, unsigned long int, std::string, 100> MarketOrder;
+
 } // end of namespace
 
 
 // Definitions of inline functions
 
-inline std::string trading::MarketOrder::toString() const {
+template <typename PriceT, typename SizeT, typename IdT, unsigned long int TickScale>
+inline std::string trading::BasicMarketOrder<PriceT,SizeT,IdT,TickScale>::toString() const {
 	std::stringstream oss;
 
 	if (type == add) {
 		oss << "AddOrder: " << timestamp << " " << id << " " << (side == buy ? "B" : "S") <<
-				" " << static_cast<double>(price) / 100 << " " << size;
+				" " << static_cast<double>(price) / TickScale << " " << size;
 	} else {
 		oss << "ReduceOrder: " << timestamp << " " << id << " " << size;
 	}
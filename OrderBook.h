@@ -14,153 +14,881 @@
 #include <tr1/unordered_map>
 #include <string>
 #include <sstream>
+#include <vector>
 #include <algorithm>
+#include <functional>
 #include <cassert>
 
+#include "DepthKernel.h"
 #include "Exceptions.h"
+#include "HugePageAllocator.h"
 #include "Log.h"
 #include "MarketOrder.h"
+#include "Status.h"
 
 namespace trading {
 
 /**
- * Order Book (for one equity) as Meyers' Singleton
+ * Container policy: std::multimap for price levels, std::tr1::unordered_map for the id index
  */
-class OrderBook {
+struct StdContainers {
+	template <typename Key, typename Value, typename Compare>
+	struct Multimap {
+		typedef std::multimap<Key,Value,Compare> type;
+	};
+
+	template <typename Key, typename Value>
+	struct Hashmap {
+		typedef std::tr1::unordered_map<Key,Value> type;
+	};
+};
+
+/**
+ * Container policy: the same containers over HugePageAllocator, so orders and the id index
+ * can live in hugepages on the owning thread's NUMA node (see HugePageArena::enable)
+ */
+struct HugePageContainers {
+	template <typename Key, typename Value, typename Compare>
+	struct Multimap {
+		typedef std::multimap<Key,Value,Compare,HugePageAllocator<std::pair<const Key,Value> > > type;
+	};
+
+	template <typename Key, typename Value>
+	struct Hashmap {
+		typedef std::tr1::unordered_map<Key,Value,std::tr1::hash<Key>,std::equal_to<Key>,
+				HugePageAllocator<std::pair<const Key,Value> > > type;
+	};
+};
+
+/**
+ * Order Book (for one equity), parameterized on price, size and id types, container policy
+ * and tick scale (price units per currency unit). getInstance() keeps the Meyers' Singleton
+ * the Pricer uses; other owners may construct independent books.
+ */
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+class BasicOrderBook {
 public:
+	// Order and field types of this book
+	typedef BasicMarketOrder<PriceT,SizeT,IdT,TickScale> Order;
+	typedef PriceT Price;
+	typedef SizeT Size;
+	typedef IdT Id;
+
+	BasicOrderBook();
+
 	// Singleton
-	static OrderBook& getInstance();
+	static BasicOrderBook& getInstance();
 
 	// Pretend executing a market order
-	static double pretendExecuteMarketOrder(const trading::OrderSide& side, const trading::MarketOrder::Size& targetSize);
+	double pretendExecuteMarketOrder(const trading::OrderSide& side, const Size& targetSize);
 
 	// Print order book
-	static std::string printBook();
+	std::string printBook() const;
 
-	// Process a new market order
-	static void processOrder(const trading::MarketOrder& order);
+	// Resting orders: bids then asks, each side best price first and in time priority,
+	// so that adding them to an empty book in this order rebuilds this book
+	void snapshot(std::vector<Order>& orders) const;
 
-private:
-	// Iterators
-	typedef std::multimap<trading::MarketOrder::Price,trading::MarketOrder>::iterator MapIter;
-	typedef std::multimap<trading::MarketOrder::Price,trading::MarketOrder>::reverse_iterator MapReverseIter;
-	typedef std::tr1::unordered_map<trading::MarketOrder::Id,MapIter>::iterator HashmapIter;
+	// What a processed order touched: the book side (buy = bids) and price level, and whether it
+	// can change the cost of executing the target size against that side
+	struct Impact {
+		trading::OrderSide side;
+		Price price;
+		bool insideFillWindow;
+	};
+
+	// Process a new market order (throws on inconsistent orders)
+	Impact processOrder(const Order& order);
+
+	// Process a new market order without exceptions; 'impact' is only valid on success
+	trading::Status processOrder(const Order& order, Impact& impact);
+
+	// Target size whose fill window processOrder reports against (0 = every update is inside)
+	void setTargetSize(const Size& targetSize);
+
+	// Aggregated price level
+	struct Level {
+		Price price;
+		Size size;
+	};
+
+	// Number of price levels cached per side
+	enum { topLevels = 5 };
+
+	// Change flags raised by processOrder (touch = best level, depth = any cached level)
+	enum Change { bidTouchChanged = 1, askTouchChanged = 2, bidDepthChanged = 4, askDepthChanged = 8 };
+
+	// Best bid/offer; bestBid()/bestAsk() are only meaningful if hasBid()/hasAsk()
+	bool hasBid() const;
+	bool hasAsk() const;
+	const Level& bestBid() const;
+	const Level& bestAsk() const;
+	long int spread() const; // in ticks; requires both sides
+
+	// Shares resting on one side (buy = bids)
+	const Size& openInterest(const trading::OrderSide& side) const;
+
+	// Top of book, best level first
+	const Level* topBids() const;
+	const Level* topAsks() const;
+	std::size_t topBidsCount() const;
+	std::size_t topAsksCount() const;
+
+	// Change flags accumulated since the last clearChanges()
+	unsigned int changes() const;
+	void clearChanges();
+
+	// Counters and footprint, all O(1) to collect. Bytes are estimates: nodes (payload plus links)
+	// and bucket arrays, not allocator headers or ids too long for the small-string buffer.
+	struct Stats {
+		std::size_t bidOrders, askOrders;           // live orders
+		std::size_t peakBidOrders, peakAskOrders;
+		std::size_t bidLevels, askLevels;           // distinct prices
+		std::size_t peakBidLevels, peakAskLevels;
+		std::size_t bidsMapBytes, asksMapBytes;
+		std::size_t bidsHashBytes, asksHashBytes;
+		std::size_t laddersBytes;
+		float bidsLoadFactor, asksLoadFactor;
+		unsigned long int rehashes;                 // bucket array regrowths, both hashes
+		unsigned long int adds, reduces, removes;   // reduces leave a smaller order, removes delete it
+		unsigned long int errors;                   // orders rejected (see Status)
+	};
 
+	Stats stats() const;
+
+	// Price pretend executions with the vectorized kernel over every level (the default), or by
+	// walking the orders one by one; switching on rebuilds the level arrays from the book
+	void setVectorizedDepth(bool vectorized);
+	bool vectorizedDepth() const;
+
+private:
 	// Multimaps: price -> order
-	typedef std::multimap<trading::MarketOrder::Price,trading::MarketOrder,std::greater<trading::MarketOrder::Price> > BidsMap;
-	typedef std::multimap<trading::MarketOrder::Price,trading::MarketOrder,std::less<trading::MarketOrder::Price> > AsksMap;
+	typedef typename ContainerPolicy::template Multimap<Price,Order,std::greater<Price> >::type BidsMap;
+	typedef typename ContainerPolicy::template Multimap<Price,Order,std::less<Price> >::type AsksMap;
 
 	// Hashmaps: order id -> multimap iterator (for quick lookup by order ID)
-	typedef std::tr1::unordered_map<trading::MarketOrder::Id,MapIter> BidsHash;
-	typedef std::tr1::unordered_map<trading::MarketOrder::Id,MapIter> AsksHash;
+	typedef typename ContainerPolicy::template Hashmap<Id,typename BidsMap::iterator>::type BidsHash;
+	typedef typename ContainerPolicy::template Hashmap<Id,typename AsksMap::iterator>::type AsksHash;
+
+	BidsMap bidsMap_;
+	AsksMap asksMap_;
+
+	BidsHash bidsHash_;
+	AsksHash asksHash_;
+
+	Size openBids_; // open interest (bids)
+	Size openAsks_; // open interest (asks)
+
+	// Top of book cache, maintained incrementally by processOrder
+	Level topBids_[topLevels];
+	Level topAsks_[topLevels];
+	std::size_t topBidsCount_;
+	std::size_t topAsksCount_;
+	unsigned int changes_;
+
+	// Every price level of one side, best first, as contiguous arrays for fillLevels
+	// (integral prices and sizes, stored as 64 bits). Size changes at a known level are applied
+	// in place; a level appearing or going away is queued instead, with every change after it,
+	// until the next walk settles them: however many levels came and went, that moves the
+	// levels behind them once for the removals and once for the additions.
+	struct Ladder {
+		std::vector<uint64_t> prices;
+		std::vector<uint64_t> sizes;
+		std::vector<std::pair<uint64_t,uint64_t> > pending; // (price, size change modulo 2^64)
+		std::vector<std::size_t> erasedAt;                  // scratch for settleLadder
+		std::vector<std::size_t> insertedAt;
+	};
+
+	bool vectorizedDepth_;
+	Ladder bidsLadder_;
+	Ladder asksLadder_;
+
+	// For stats()
+	std::size_t bidLevels_;
+	std::size_t askLevels_;
+	std::size_t peakBidOrders_;
+	std::size_t peakAskOrders_;
+	std::size_t peakBidLevels_;
+	std::size_t peakAskLevels_;
+	unsigned long int rehashes_;
+	unsigned long int reduces_; // partial; full reductions are counted as removes_
+	unsigned long int removes_;
+	StatusCounters statusCounts_;
+
+	// Outcome of the last pretendExecuteMarketOrder for targetSize_ against one side
+	struct FillWindow {
+		bool known;     // false once an update inside the window may have moved it
+		bool fillable;  // enough open interest for targetSize_
+		Price boundary; // price of the level that completed the fill
+	};
+
+	Size targetSize_;
+	FillWindow bidsWindow_; // sell market orders execute against bids
+	FillWindow asksWindow_; // buy market orders execute against asks
 
-	static BidsMap bidsMap_; // only declare (define in .cpp)
-	static AsksMap asksMap_;
+	// Walk one side for pretendExecuteMarketOrder, recording its fill window for targetSize_
+	template <typename Map>
+	double walkDepth(const Map& map, const Size& openInterest, const Size& targetSize, FillWindow& window) const;
 
-	static BidsHash bidsHash_; // only declare (define in .cpp)
-	static AsksHash asksHash_;
+	// processOrder without the statistics
+	trading::Status applyOrder(const Order& order, Impact& impact);
 
-	static trading::MarketOrder::Size openBids_; // open interest (bids)
-	static trading::MarketOrder::Size openAsks_; // open interest (asks)
+	// Is 'it' the only order at its price?
+	template <typename Map>
+	static bool aloneAtPrice(const Map& map, typename Map::iterator it);
+
+	// Same over the side's ladder
+	double walkLadder(const Ladder& ladder, const Size& openInterest, const Size& targetSize, FillWindow& window) const;
+
+	// Classify an update at 'price' on one side, invalidating the window if it falls inside
+	Impact impactOf(const trading::OrderSide& side, const Price& price, bool added);
+
+	// Apply an add (added = true) or a reduce of 'size' at 'price' to the cached levels of one side,
+	// after 'map' itself has been updated. Returns 0, or depthChanged with touchChanged if the best level moved.
+	template <typename Map>
+	static unsigned int updateLevels(Level* levels, std::size_t& count, const Map& map,
+			const Price& price, const Size& size, bool added,
+			unsigned int touchChanged, unsigned int depthChanged);
+
+	// Apply the same add or reduce to a ladder (if vectorizedDepth_), or queue it
+	template <typename Compare>
+	void updateLadder(Ladder& ladder, Compare better, const Price& price, const Size& size, bool added);
+
+	// Orders queued ladder changes by price, best first
+	template <typename Compare>
+	struct PendingOrder {
+		Compare better;
+		explicit PendingOrder(Compare better) : better(better) { }
+		bool operator()(const std::pair<uint64_t,uint64_t>& a, const std::pair<uint64_t,uint64_t>& b) const { return better(a.first, b.first); }
+	};
+
+	// Apply the queued changes to a ladder before walking it
+	template <typename Compare>
+	static void settleLadder(Ladder& ladder, Compare better);
+
+	// Aggregate one side of the book into a ladder
+	template <typename Map>
+	static void buildLadder(Ladder& ladder, const Map& map);
 
-// Singleton stuff
 private:
-	OrderBook() { };
-	OrderBook(OrderBook const&);      // Don't Implement
-	void operator=(OrderBook const&); // Don't implement
+	BasicOrderBook(BasicOrderBook const&); // Don't Implement
+	void operator=(BasicOrderBook const&); // Don't implement
 
 };
 
+// Containers of the Pricer's books: std by default; built with -DPRICER_HUGEPAGES (make hugepages),
+// every book goes through HugePageAllocator and --hugepages can move them into hugepages
+#ifdef PRICER_HUGEPAGES
+typedef HugePageContainers BookContainers;
+#else
+typedef StdContainers BookContainers;
+#endif
+
+// The Pricer's book: prices in cents, string ids
+typedef BasicOrderBook<MarketOrder::Price,MarketOrder::Size,MarketOrder::Id,BookContainers,100> OrderBook;
+
+// Instantiated once, in OrderBook.cpp
+extern template class BasicOrderBook<MarketOrder::Price,MarketOrder::Size,MarketOrder::Id,BookContainers,100>;
+
 } // end of namespace
 
 
 // Definitions of inline functions
 
-inline trading::OrderBook& trading::OrderBook::getInstance() {
-	static OrderBook _instance; // Guaranteed to be destroyed. Instantiated on first use.
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::BasicOrderBook()
+	: openBids_(0), openAsks_(0), topBidsCount_(0), topAsksCount_(0), changes_(0), vectorizedDepth_(true),
+	  bidLevels_(0), askLevels_(0), peakBidOrders_(0), peakAskOrders_(0), peakBidLevels_(0), peakAskLevels_(0),
+	  rehashes_(0), reduces_(0), removes_(0), targetSize_(0) {
+	bidsWindow_.known = false;
+	asksWindow_.known = false;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>& trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::getInstance() {
+	static BasicOrderBook _instance; // Guaranteed to be destroyed. Instantiated on first use.
 	return _instance;
 }
 
-inline void trading::OrderBook::processOrder(const trading::MarketOrder& order) {
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline bool trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::hasBid() const {
+	return topBidsCount_ > 0;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline bool trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::hasAsk() const {
+	return topAsksCount_ > 0;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline const typename trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::Level& trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::bestBid() const {
+	return topBids_[0];
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline const typename trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::Level& trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::bestAsk() const {
+	return topAsks_[0];
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline long int trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::spread() const {
+	assert(hasBid() && hasAsk());
+	return static_cast<long int>(topAsks_[0].price) - static_cast<long int>(topBids_[0].price);
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline const SizeT& trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::openInterest(const trading::OrderSide& side) const {
+	return (side == buy) ? openBids_ : openAsks_;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline const typename trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::Level* trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::topBids() const {
+	return topBids_;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline const typename trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::Level* trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::topAsks() const {
+	return topAsks_;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline std::size_t trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::topBidsCount() const {
+	return topBidsCount_;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline std::size_t trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::topAsksCount() const {
+	return topAsksCount_;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline unsigned int trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::changes() const {
+	return changes_;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline void trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::clearChanges() {
+	changes_ = 0;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline typename trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::Stats trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::stats() const {
+	const std::size_t mapNodeLinks = 4 * sizeof(void*);  // color (padded), parent, left, right
+	const std::size_t hashNodeLinks = sizeof(void*);     // next
 
-	// Pair for the tree
-	std::pair<trading::MarketOrder::Price,trading::MarketOrder> priceOrderPair =
-			std::pair<trading::MarketOrder::Price,trading::MarketOrder>(order.price,order);
+	Stats stats;
+	stats.bidOrders = bidsHash_.size();
+	stats.askOrders = asksHash_.size();
+	stats.peakBidOrders = peakBidOrders_;
+	stats.peakAskOrders = peakAskOrders_;
+	stats.bidLevels = bidLevels_;
+	stats.askLevels = askLevels_;
+	stats.peakBidLevels = peakBidLevels_;
+	stats.peakAskLevels = peakAskLevels_;
+	stats.bidsMapBytes = bidsMap_.size() * (sizeof(typename BidsMap::value_type) + mapNodeLinks);
+	stats.asksMapBytes = asksMap_.size() * (sizeof(typename AsksMap::value_type) + mapNodeLinks);
+	stats.bidsHashBytes = bidsHash_.size() * (sizeof(typename BidsHash::value_type) + hashNodeLinks) +
+			bidsHash_.bucket_count() * sizeof(void*);
+	stats.asksHashBytes = asksHash_.size() * (sizeof(typename AsksHash::value_type) + hashNodeLinks) +
+			asksHash_.bucket_count() * sizeof(void*);
+	stats.laddersBytes = (bidsLadder_.prices.capacity() + bidsLadder_.sizes.capacity() +
+			asksLadder_.prices.capacity() + asksLadder_.sizes.capacity()) * sizeof(uint64_t) +
+			(bidsLadder_.pending.capacity() + asksLadder_.pending.capacity()) * sizeof(std::pair<uint64_t,uint64_t>) +
+			(bidsLadder_.erasedAt.capacity() + bidsLadder_.insertedAt.capacity() +
+			asksLadder_.erasedAt.capacity() + asksLadder_.insertedAt.capacity()) * sizeof(std::size_t);
+	stats.bidsLoadFactor = bidsHash_.load_factor();
+	stats.asksLoadFactor = asksHash_.load_factor();
+	stats.rehashes = rehashes_;
+	stats.adds = statusCounts_.count(success) - reduces_ - removes_;
+	stats.reduces = reduces_;
+	stats.removes = removes_;
+	stats.errors = statusCounts_.errors();
+	return stats;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+template <typename Map>
+inline bool trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::aloneAtPrice(const Map& map, typename Map::iterator it) {
+	Price price = it->first;
+	typename Map::iterator next = it;
+	if (++next != map.end() && next->first == price) {
+		return false;
+	}
+	return it == map.begin() || (--it)->first != price;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline void trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::setVectorizedDepth(bool vectorized) {
+	if (vectorized && !vectorizedDepth_) {
+		buildLadder(bidsLadder_, bidsMap_);
+		buildLadder(asksLadder_, asksMap_);
+	} else if (!vectorized) {
+		bidsLadder_ = Ladder();
+		asksLadder_ = Ladder();
+	}
+	vectorizedDepth_ = vectorized;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline bool trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::vectorizedDepth() const {
+	return vectorizedDepth_;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline void trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::setTargetSize(const Size& targetSize) {
+	targetSize_ = targetSize;
+	bidsWindow_.known = false;
+	asksWindow_.known = false;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline typename trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::Impact trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::impactOf(const trading::OrderSide& side, const Price& price, bool added) {
+	FillWindow& window = (side == buy) ? bidsWindow_ : asksWindow_;
+	Impact impact = { side, price, true };
 
-	// Pair for the hashmap
-	std::pair<trading::MarketOrder::Id,MapIter> idIterPair;
+	if (window.known) {
+		if (!window.fillable) { // only more open interest can make the order executable
+			impact.insideFillWindow = added;
+		} else if (price == window.boundary) { // an add at the boundary queues behind the fill
+			impact.insideFillWindow = !added;
+		} else { // strictly better than the boundary?
+			impact.insideFillWindow = (side == buy) ? (price > window.boundary) : (price < window.boundary);
+		}
+	}
+
+	if (impact.insideFillWindow) {
+		window.known = false;
+	}
+	return impact;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+template <typename Map>
+inline unsigned int trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::updateLevels(Level* levels, std::size_t& count, const Map& map,
+		const Price& price, const Size& size, bool added,
+		unsigned int touchChanged, unsigned int depthChanged) {
 
-	// both for the tree and the hashmap
-	MapIter mapIter; // for the return value when inserting into multimap
-	HashmapIter hmIter;
-	std::pair<HashmapIter,bool> hashRet; // for the return value when inserting into hashmap
+	// Find the level (or where it would go), best first
+	typename Map::key_compare better = map.key_comp();
+	std::size_t i = 0;
+	while (i < count && better(levels[i].price, price)) {
+		i++;
+	}
+
+	if (i < count && levels[i].price == price) { // cached level
+		if (added) {
+			levels[i].size += size;
+		} else {
+			levels[i].size -= size;
+		}
+
+		if (levels[i].size == 0) { // level is gone: shift up and refill the last slot from the map
+			std::copy(levels + i + 1, levels + count, levels + i);
+			count--;
+			typename Map::const_iterator it = (count == 0) ? map.begin() : map.upper_bound(levels[count - 1].price);
+			if (it != map.end()) {
+				Level refill = { it->first, 0 };
+				for (; it != map.end() && it->first == refill.price; it++) {
+					refill.size += it->second.size;
+				}
+				levels[count++] = refill;
+			}
+		}
+	} else { // new level
+		if (!added || i == topLevels) { // beyond cached depth
+			return 0;
+		}
+		if (count == topLevels) { // drop the worst cached level
+			count--;
+		}
+		std::copy_backward(levels + i, levels + count, levels + count + 1);
+		levels[i].price = price;
+		levels[i].size = size;
+		count++;
+	}
+
+	return (i == 0) ? (touchChanged | depthChanged) : depthChanged;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+template <typename Compare>
+inline void trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::updateLadder(Ladder& ladder, Compare better,
+		const Price& price, const Size& size, bool added) {
+	if (!vectorizedDepth_) {
+		return;
+	}
+
+	uint64_t change = added ? static_cast<uint64_t>(size) : 0 - static_cast<uint64_t>(size);
+	if (ladder.pending.empty()) { // the ladder is current: change the level in place if it stays
+		std::vector<uint64_t>::iterator at = std::lower_bound(ladder.prices.begin(), ladder.prices.end(),
+				static_cast<uint64_t>(price), better);
+		bool found = at != ladder.prices.end() && *at == static_cast<uint64_t>(price);
+		if (found && ladder.sizes[at - ladder.prices.begin()] + change != 0) {
+			ladder.sizes[at - ladder.prices.begin()] += change;
+			return;
+		}
+		if (!found && !added) { // not a level of this side
+			return;
+		}
+	}
+	ladder.pending.push_back(std::make_pair(static_cast<uint64_t>(price), change));
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+template <typename Compare>
+inline void trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::settleLadder(Ladder& ladder, Compare better) {
+	if (ladder.pending.empty()) {
+		return;
+	}
+
+	// Net change per price, best first
+	std::vector<std::pair<uint64_t,uint64_t> >& pending = ladder.pending;
+	if (pending.size() > 1) {
+		std::sort(pending.begin(), pending.end(), PendingOrder<Compare>(better));
+	}
+	std::size_t changes = 0;
+	for (std::size_t j = 0; j < pending.size(); j++) {
+		if (changes > 0 && pending[changes - 1].first == pending[j].first) {
+			pending[changes - 1].second += pending[j].second;
+		} else {
+			pending[changes++] = pending[j];
+		}
+	}
+
+	// Resize the levels that stay; note the ones that go, and keep in 'pending' the ones that come,
+	// each with the index it goes before once the others have gone
+	ladder.erasedAt.clear();
+	ladder.insertedAt.clear();
+	std::size_t inserted = 0;
+	std::size_t at = 0;
+	for (std::size_t j = 0; j < changes; j++) {
+		if (pending[j].second == 0) {
+			continue;
+		}
+		at = std::lower_bound(ladder.prices.begin() + at, ladder.prices.end(), pending[j].first, better) - ladder.prices.begin();
+		if (at < ladder.prices.size() && ladder.prices[at] == pending[j].first) {
+			if ((ladder.sizes[at] += pending[j].second) == 0) {
+				ladder.erasedAt.push_back(at);
+			}
+		} else {
+			ladder.insertedAt.push_back(at - ladder.erasedAt.size());
+			pending[inserted++] = pending[j];
+		}
+	}
+
+	// Close the gaps front to back, then open the new ones back to front
+	if (!ladder.erasedAt.empty()) {
+		std::size_t write = ladder.erasedAt[0];
+		for (std::size_t m = 0; m < ladder.erasedAt.size(); m++) {
+			std::size_t from = ladder.erasedAt[m] + 1;
+			std::size_t to = (m + 1 < ladder.erasedAt.size()) ? ladder.erasedAt[m + 1] : ladder.prices.size();
+			std::copy(ladder.prices.begin() + from, ladder.prices.begin() + to, ladder.prices.begin() + write);
+			std::copy(ladder.sizes.begin() + from, ladder.sizes.begin() + to, ladder.sizes.begin() + write);
+			write += to - from;
+		}
+		ladder.prices.resize(write);
+		ladder.sizes.resize(write);
+	}
+	if (inserted > 0) {
+		std::size_t end = ladder.prices.size();
+		ladder.prices.resize(end + inserted);
+		ladder.sizes.resize(end + inserted);
+		for (std::size_t m = inserted; m-- > 0; ) {
+			std::size_t before = ladder.insertedAt[m];
+			std::copy_backward(ladder.prices.begin() + before, ladder.prices.begin() + end, ladder.prices.begin() + end + m + 1);
+			std::copy_backward(ladder.sizes.begin() + before, ladder.sizes.begin() + end, ladder.sizes.begin() + end + m + 1);
+			ladder.prices[before + m] = pending[m].first;
+			ladder.sizes[before + m] = pending[m].second;
+			end = before;
+		}
+	}
+	pending.clear();
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+template <typename Map>
+inline void trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::buildLadder(Ladder& ladder, const Map& map) {
+	ladder = Ladder();
+	for (typename Map::const_iterator it = map.begin(); it != map.end(); it++) {
+		if (ladder.prices.empty() || ladder.prices.back() != static_cast<uint64_t>(it->first)) {
+			ladder.prices.push_back(it->first);
+			ladder.sizes.push_back(0);
+		}
+		ladder.sizes.back() += it->second.size;
+	}
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline typename trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::Impact trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::processOrder(const Order& order) {
+	Impact impact;
+	throwOnError(processOrder(order, impact));
+	return impact;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline trading::Status trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::processOrder(const Order& order, Impact& impact) {
+	Status status = applyOrder(order, impact);
+	statusCounts_.record(status);
+	return status;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+inline trading::Status trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::applyOrder(const Order& order, Impact& impact) {
+
+	// Pairs for the trees
+	std::pair<Price,Order> priceOrderPair = std::pair<Price,Order>(order.price,order);
+
+	// Pairs for the hashmaps; the multimap iterator is filled in once the id is known to be new
+	std::pair<Id,typename BidsMap::iterator> idBidIterPair = std::pair<Id,typename BidsMap::iterator>(order.id,typename BidsMap::iterator());
+	std::pair<Id,typename AsksMap::iterator> idAskIterPair = std::pair<Id,typename AsksMap::iterator>(order.id,typename AsksMap::iterator());
+
+	// for the return values when inserting into / looking up in the hashmaps
+	std::pair<typename BidsHash::iterator,bool> bidsHashRet;
+	std::pair<typename AsksHash::iterator,bool> asksHashRet;
+	typename BidsHash::iterator bidsHmIter;
+	typename AsksHash::iterator asksHmIter;
+	std::size_t bucketCount; // to spot rehashes
 
 	switch (order.type) {
 	case add: // new order
 
 		switch (order.side) {
 		case buy:
-			mapIter = bidsMap_.insert(priceOrderPair); // Update the order multimap (price->order); order O(log n)
-			idIterPair = std::pair<trading::MarketOrder::Id,MapIter>(order.id,mapIter); // We store this in hashmap
-			hashRet = bidsHash_.insert(idIterPair); // Update the hashmap; order O(1)
-			if (!hashRet.second) {
-				throw DuplicateOrderId();
+			bucketCount = bidsHash_.bucket_count();
+			bidsHashRet = bidsHash_.insert(idBidIterPair); // Update the hashmap; order O(1)
+			if (!bidsHashRet.second) {
+				return duplicateOrderId;
 			}
+			bidsHashRet.first->second = bidsMap_.insert(priceOrderPair); // Update the order multimap (price->order); order O(log n)
 			openBids_ += order.size;
+			if (bidsHash_.bucket_count() != bucketCount) {
+				rehashes_++;
+			}
+			if (aloneAtPrice(bidsMap_, bidsHashRet.first->second)) {
+				peakBidLevels_ = std::max(peakBidLevels_, ++bidLevels_);
+			}
+			peakBidOrders_ = std::max(peakBidOrders_, bidsHash_.size());
+			changes_ |= updateLevels(topBids_, topBidsCount_, bidsMap_, order.price, order.size, true, bidTouchChanged, bidDepthChanged);
+			updateLadder(bidsLadder_, std::greater<uint64_t>(), order.price, order.size, true);
 			FILE_LOG(logDEBUG) << "Adding 'Buy' order: " << order.toString();
-			break;
+			impact = impactOf(buy, order.price, true);
+			return success;
 		case sell:
-			mapIter = asksMap_.insert(priceOrderPair);
-			idIterPair = std::pair<trading::MarketOrder::Id,MapIter>(order.id,mapIter);
-			hashRet = asksHash_.insert(idIterPair);
-			if (!hashRet.second) {
-				throw DuplicateOrderId();
+			bucketCount = asksHash_.bucket_count();
+			asksHashRet = asksHash_.insert(idAskIterPair);
+			if (!asksHashRet.second) {
+				return duplicateOrderId;
 			}
+			asksHashRet.first->second = asksMap_.insert(priceOrderPair);
 			openAsks_ += order.size;
+			if (asksHash_.bucket_count() != bucketCount) {
+				rehashes_++;
+			}
+			if (aloneAtPrice(asksMap_, asksHashRet.first->second)) {
+				peakAskLevels_ = std::max(peakAskLevels_, ++askLevels_);
+			}
+			peakAskOrders_ = std::max(peakAskOrders_, asksHash_.size());
+			changes_ |= updateLevels(topAsks_, topAsksCount_, asksMap_, order.price, order.size, true, askTouchChanged, askDepthChanged);
+			updateLadder(asksLadder_, std::less<uint64_t>(), order.price, order.size, true);
 			FILE_LOG(logDEBUG) << "Adding 'Sell' order: " << order.toString();
-			break;
+			impact = impactOf(sell, order.price, true);
+			return success;
 		default:
-			throw BadOrderSide();
+			return badOrderSide;
 		}
 
-		break;
-
 	case reduce: // update existing order
-		if ((hmIter = bidsHash_.find(order.id)) != bidsHash_.end()) { // working with bids
-			mapIter = hmIter->second;
-			trading::MarketOrder& orderFromMap = mapIter->second;
+		if ((bidsHmIter = bidsHash_.find(order.id)) != bidsHash_.end()) { // working with bids
+			typename BidsMap::iterator mapIter = bidsHmIter->second;
+			Order& orderFromMap = mapIter->second;
 			FILE_LOG(logDEBUG) << "Reducing 'Buy' order " << orderFromMap.toString();
-			if (orderFromMap.size - order.size <= 0) { // need to remove order completely
-				openBids_ -= orderFromMap.size; // update open interest
+			Price price = orderFromMap.price;
+			if (order.size >= orderFromMap.size) { // need to remove order completely
+				Size removed = orderFromMap.size;
+				openBids_ -= removed;         // update open interest
+				if (aloneAtPrice(bidsMap_, mapIter)) {
+					bidLevels_--;
+				}
+				removes_++;
 				bidsMap_.erase(mapIter);        // delete from map
-				bidsHash_.erase(hmIter);        // delete from hashmap
+				bidsHash_.erase(bidsHmIter);    // delete from hashmap
+				changes_ |= updateLevels(topBids_, topBidsCount_, bidsMap_, price, removed, false, bidTouchChanged, bidDepthChanged);
+				updateLadder(bidsLadder_, std::greater<uint64_t>(), price, removed, false);
 				FILE_LOG(logDEBUG) << "Removed order completely: " << order.toString();
 			} else { // need to update order
 				orderFromMap.size -= order.size; // update in map
 				openBids_ -= order.size;        // update open interest
+				reduces_++;
+				changes_ |= updateLevels(topBids_, topBidsCount_, bidsMap_, price, order.size, false, bidTouchChanged, bidDepthChanged);
+				updateLadder(bidsLadder_, std::greater<uint64_t>(), price, order.size, false);
 				FILE_LOG(logDEBUG) << "Adjusted size of order; new order: " << orderFromMap.toString();
 			}
-
-		} else if ((hmIter = asksHash_.find(order.id)) != asksHash_.end()) { // working with asks
-			mapIter = hmIter->second;
-			trading::MarketOrder& orderFromMap = mapIter->second;
+			impact = impactOf(buy, price, false);
+			return success;
+		} else if ((asksHmIter = asksHash_.find(order.id)) != asksHash_.end()) { // working with asks
+			typename AsksMap::iterator mapIter = asksHmIter->second;
+			Order& orderFromMap = mapIter->second;
 			FILE_LOG(logDEBUG) << "Reducing 'Sell' order " << orderFromMap.toString();
-			if (orderFromMap.size - order.size <= 0) { // need to remove order completely;
-				openAsks_ -= orderFromMap.size; // update open interest
+			Price price = orderFromMap.price;
+			if (order.size >= orderFromMap.size) { // need to remove order completely;
+				Size removed = orderFromMap.size;
+				openAsks_ -= removed;         // update open interest
+				if (aloneAtPrice(asksMap_, mapIter)) {
+					askLevels_--;
+				}
+				removes_++;
 				asksMap_.erase(mapIter);        // delete from map
-				asksHash_.erase(hmIter);        // delete from hashmap
+				asksHash_.erase(asksHmIter);    // delete from hashmap
+				changes_ |= updateLevels(topAsks_, topAsksCount_, asksMap_, price, removed, false, askTouchChanged, askDepthChanged);
+				updateLadder(asksLadder_, std::less<uint64_t>(), price, removed, false);
 				FILE_LOG(logDEBUG) << "Removed order completely: " << order.toString();
 			} else { // need to update order
 				orderFromMap.size -= order.size; // update in map
 				openAsks_ -= order.size;        // update open interest
+				reduces_++;
+				changes_ |= updateLevels(topAsks_, topAsksCount_, asksMap_, price, order.size, false, askTouchChanged, askDepthChanged);
+				updateLadder(asksLadder_, std::less<uint64_t>(), price, order.size, false);
 				FILE_LOG(logDEBUG) << "Adjusted size of order; new order: " << orderFromMap.toString();
 			}
+			impact = impactOf(sell, price, false);
+			return success;
 		} else {
-			throw AttempToReduceNonexistantOrder();
+			return reduceNonexistentOrder;
+		}
+	default:
+		return badOrderType; // should never be here
+	}
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+double trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::pretendExecuteMarketOrder(const trading::OrderSide& side, const Size& targetSize) {
+
+	if (targetSize < 1) { // sanity check
+		throw trading::BadOrderSize();
+	}
+
+	assert(targetSize >= 1); // in case someone removes the throw above
+
+	switch (side) {
+	case trading::buy:
+		if (!vectorizedDepth_) {
+			return walkDepth(asksMap_, openAsks_, targetSize, asksWindow_);
+		}
+		settleLadder(asksLadder_, std::less<uint64_t>());
+		return walkLadder(asksLadder_, openAsks_, targetSize, asksWindow_);
+	case trading::sell:
+		if (!vectorizedDepth_) {
+			return walkDepth(bidsMap_, openBids_, targetSize, bidsWindow_);
 		}
-		break;
+		settleLadder(bidsLadder_, std::greater<uint64_t>());
+		return walkLadder(bidsLadder_, openBids_, targetSize, bidsWindow_);
 	default:
-		throw BadOrderType(); // should never be here
+		throw trading::BadOrderSide();
+	}
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+template <typename Map>
+double trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::walkDepth(const Map& map, const Size& openInterest, const Size& targetSize, FillWindow& window) const {
+	Size sizeCompleted = 0; // how much of the order size we have completed
+	double amount = 0;      // how much we've spent/received from execution
+
+	if (targetSize > openInterest) { // not possible to execute
+		if (targetSize == targetSize_) {
+			window.known = true;
+			window.fillable = false;
+		}
+		return 0;
+	}
+
+	// enough open interest to execute
+	for (typename Map::const_iterator it = map.begin(); it != map.end(); it++) {
+		const Order& order = it->second;
+		FILE_LOG(logDEBUG) << "Using order " << order.toString() << " to execute";
+		double price = static_cast<double>(order.price)/TickScale;
+		Size sizeFromCurrentOrder = std::min(order.size,static_cast<Size>(targetSize - sizeCompleted));
+
+		sizeCompleted += sizeFromCurrentOrder;
+		amount += sizeFromCurrentOrder * price;
+
+		if (sizeCompleted == targetSize) {
+			if (targetSize == targetSize_) {
+				window.known = true;
+				window.fillable = true;
+				window.boundary = order.price;
+			}
+			return amount;
+		}
+	}
+
+	// should never get here
+	assert(false);
+	return 0;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+double trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::walkLadder(const Ladder& ladder, const Size& openInterest, const Size& targetSize, FillWindow& window) const {
+	std::size_t level = 0;
+	double notional = 0; // in ticks
+
+	if (targetSize > openInterest ||
+			!fillLevels(ladder.sizes.data(), ladder.prices.data(), ladder.sizes.size(), targetSize, level, notional)) {
+		if (targetSize == targetSize_) {
+			window.known = true;
+			window.fillable = false;
+		}
+		return 0;
+	}
+
+	if (targetSize == targetSize_) {
+		window.known = true;
+		window.fillable = true;
+		window.boundary = ladder.prices[level];
+	}
+	return notional / TickScale;
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+std::string trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::printBook() const {
+	std::stringstream oss;
+
+	oss << std::endl ;
+	oss << "Order book:" << std::endl;
+	oss << "Bids\t\tAsks" << std::endl;
+
+
+	for (typename AsksMap::const_reverse_iterator it = asksMap_.rbegin(); it != asksMap_.rend(); it++) {
+		const Order& order = it->second;
+		oss << "\t\t" << static_cast<double>(order.price) / TickScale << " x " << order.size << "\t// " << order.toString() << std::endl;
+	}
+
+	for (typename BidsMap::const_iterator it = bidsMap_.begin(); it != bidsMap_.end(); it++) {
+		const Order& order = it->second;
+		oss << "" << static_cast<double>(order.price) / TickScale << " x " << order.size << "\t\t\t// " << order.toString() << std::endl;
+	}
+
+	oss << std::endl;
+	oss << "Open bids = " << openBids_ << std::endl;
+	oss << "Open asks = " << openAsks_ << std::endl;
+	if (hasBid()) {
+		oss << "Best bid = " << static_cast<double>(bestBid().price) / TickScale << " x " << bestBid().size << std::endl;
+	}
+	if (hasAsk()) {
+		oss << "Best ask = " << static_cast<double>(bestAsk().price) / TickScale << " x " << bestAsk().size << std::endl;
+	}
+
+	return oss.str();
+}
+
+template <typename PriceT, typename SizeT, typename IdT, typename ContainerPolicy, unsigned long int TickScale>
+void trading::BasicOrderBook<PriceT,SizeT,IdT,ContainerPolicy,TickScale>::snapshot(std::vector<Order>& orders) const {
+	orders.clear();
+	orders.reserve(bidsHash_.size() + asksHash_.size());
+	for (typename BidsMap::const_iterator it = bidsMap_.begin(); it != bidsMap_.end(); it++) {
+		orders.push_back(it->second);
+	}
+	for (typename AsksMap::const_iterator it = asksMap_.begin(); it != asksMap_.end(); it++) {
+		orders.push_back(it->second);
 	}
 }
 
@@ -16,44 +16,81 @@
 #include "MarketOrder.h"
 #include "Log.h"
 #include "Exceptions.h"
+#include "Status.h"
 #include "Utils.h"
 
 namespace trading {
 
-class Parser {
+// Order id from its text field: string ids are copied, other id types are streamed in;
+// false if the field is not an id of that type
+template <typename Id>
+bool readOrderId(const std::string& field, Id& id);
+bool readOrderId(const std::string& field, std::string& id);
+
+// Order is a BasicMarketOrder; prices are scaled by its tick scale
+template <typename Order>
+class BasicParser {
 public:
-	// Basic Market Order Parser
-	static MarketOrder parse(const std::string& msg);
+	// Basic Market Order Parser (throws on bad messages)
+	static Order parse(const std::string& msg);
+
+	// Basic Market Order Parser without exceptions; 'order' is only valid on success
+	static Status parse(const std::string& msg, Order& order);
 };
 
+// The Pricer's parser
+typedef BasicParser<MarketOrder> Parser;
+
 } // end of namespace
 
 
 // Definitions of inline functions
 
-inline trading::MarketOrder trading::Parser::parse(const std::string& msg) {
+template <typename Id>
+inline bool trading::readOrderId(const std::string& field, Id& id) {
+	std::istringstream is(field);
+	return (is >> id) && is.peek() == std::char_traits<char>::eof(); // all of it, e.g. not "12x" for an integer id
+}
+
+inline bool trading::readOrderId(const std::string& field, std::string& id) {
+	id = field;
+	return true;
+}
+
+template <typename Order>
+inline Order trading::BasicParser<Order>::parse(const std::string& msg) {
+	Order order;
+	throwOnError(parse(msg, order));
+	return order;
+}
+
+template <typename Order>
+inline trading::Status trading::BasicParser<Order>::parse(const std::string& msg, Order& order) {
 	// Get fields
 	std::vector<std::string> fields = tokenize(msg, ' ');
 
 	// Basic check
 	if (fields.size() != 4) {
 		if (fields.size() != 6) {
-			throw BadParse();
+			return badParse;
 		}
 	}
 
-	MarketOrder order;
-
 	// Parse order type
 	std::string orderType = fields.at(1);
 	if (orderType.compare("A") == 0) {
+		if (fields.size() != 6) {
+			return badParse;
+		}
 
 		// "Add order": 28800562 A c B 44.10 100
 		//                     0 1 2 3     4   5
 
 		order.timestamp = std::atol(fields.at(0).c_str());
 		order.type = add;
-		order.id = fields.at(2);
+		if (!readOrderId(fields.at(2), order.id)) {
+			return badParse;
+		}
 
 		// Order side
 		std::string orderSide = fields.at(3);
@@ -62,26 +99,31 @@ inline trading::MarketOrder trading::Parser::parse(const std::string& msg) {
 		} else if (orderSide.compare("S") == 0) {
 			order.side = sell;
 		} else {
-			throw BadParse();
+			return badParse;
 		}
 
-		order.price = static_cast<unsigned long int>(100 * std::atof(fields.at(4).c_str()));
-		order.size = std::atol(fields.at(5).c_str());
+		order.price = static_cast<typename Order::Price>(Order::tickScale * std::atof(fields.at(4).c_str()) + 0.5); // round to the nearest tick
+		order.size = static_cast<typename Order::Size>(std::atol(fields.at(5).c_str()));
 	} else if (orderType.compare("R") == 0) {
+		if (fields.size() != 4) {
+			return badParse;
+		}
 
 		// "Reduce order": 28800744 R b 100
 		//                        0 1 2   3
 
 		order.timestamp = std::atol(fields.at(0).c_str());
 		order.type = reduce;
-		order.id = fields.at(2);
-		order.size = std::atol(fields.at(3).c_str());
+		if (!readOrderId(fields.at(2), order.id)) {
+			return badParse;
+		}
+		order.size = static_cast<typename Order::Size>(std::atol(fields.at(3).c_str()));
 	} else { // bad parse
-		throw BadParse();
+		return badParse;
 	}
 
 	FILE_LOG(logDEBUG) << "Parsed order: " << order.toString();
-	return order;
+	return success;
 }
 
 #endif /* PARSER_H_ */
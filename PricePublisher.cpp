@@ -0,0 +1,73 @@
+//==========================================================================
+// Name        : PricePublisher.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Publishes pricing results to POSIX shared memory under a seqlock
+//==========================================================================
+
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Log.h"
+#include "PricePublisher.h"
+
+trading::PricePublisher::PricePublisher(const std::string& name) : segment_(0) {
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		FILE_LOG(logERROR) << "Could not open shared memory " << name;
+		throw BadSharedMemory();
+	}
+	if (ftruncate(fd, sizeof(Segment)) != 0) {
+		close(fd);
+		throw BadSharedMemory();
+	}
+	void* mem = mmap(0, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		throw BadSharedMemory();
+	}
+
+	// Start over: readers see "nothing published" until the first snapshot
+	segment_ = static_cast<Segment*>(mem);
+	segment_->seqlock.store(0, std::memory_order_relaxed);
+	segment_->snapshot = PriceSnapshot();
+	segment_->version = segmentVersion;
+	segment_->magic = segmentMagic;
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+trading::PricePublisher::~PricePublisher() {
+	munmap(segment_, sizeof(Segment));
+}
+
+trading::PricePublisher::Reader::Reader(const std::string& name) : segment_(0) {
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		throw BadSharedMemory();
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Segment))) {
+		close(fd);
+		throw BadSharedMemory();
+	}
+	void* mem = mmap(0, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		throw BadSharedMemory();
+	}
+
+	const Segment* segment = static_cast<const Segment*>(mem);
+	if (segment->magic != segmentMagic || segment->version != segmentVersion) {
+		munmap(mem, sizeof(Segment));
+		throw BadSharedMemory();
+	}
+	segment_ = mem;
+}
+
+trading::PricePublisher::Reader::~Reader() {
+	munmap(const_cast<void*>(segment_), sizeof(Segment));
+}
@@ -0,0 +1,113 @@
+//============================================================================
+// Name        : PricePublisher.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Publishes pricing results to POSIX shared memory under a seqlock
+//============================================================================
+
+#ifndef PRICEPUBLISHER_H_
+#define PRICEPUBLISHER_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include "Exceptions.h"
+
+namespace trading {
+
+// Latest pricing results, as consumers see them
+struct PriceSnapshot {
+	uint64_t sequence;     // messages applied to the book so far
+	uint64_t timestamp;    // of the last message applied
+	uint64_t targetSize;
+	double buyAmount;      // cost to buy targetSize; 0 = not enough asks (NA)
+	double sellAmount;     // proceeds from selling targetSize; 0 = not enough bids (NA)
+	uint64_t bestBidPrice; // in ticks; 0 = no bids
+	uint64_t bestBidSize;
+	uint64_t bestAskPrice; // in ticks; 0 = no asks
+	uint64_t bestAskSize;
+	uint64_t tickScale;    // ticks per currency unit
+};
+
+/**
+ * Price Publisher: single writer of a PriceSnapshot in a POSIX shared memory segment.
+ * Readers in other processes map the segment with PricePublisher::Reader and read
+ * the latest snapshot with a few loads and no system calls.
+ */
+class PricePublisher {
+public:
+	// Create (or take over) the segment, e.g. "/pricer"; throws BadSharedMemory
+	explicit PricePublisher(const std::string& name);
+
+	// Unmaps; the segment stays so that readers keep the last snapshot
+	~PricePublisher();
+
+	// Seqlock write: readers never see a half-written snapshot
+	void publish(const PriceSnapshot& snapshot);
+
+	/**
+	 * Consumer side: maps the segment read-only
+	 */
+	class Reader {
+	public:
+		// Throws BadSharedMemory if there is no such segment or it has another layout
+		explicit Reader(const std::string& name);
+		~Reader();
+
+		// Copy the latest snapshot, retrying while the writer is mid-update;
+		// false if nothing has been published yet
+		bool read(PriceSnapshot& snapshot) const;
+
+	private:
+		const void* segment_;
+
+		Reader(Reader const&);         // Don't Implement
+		void operator=(Reader const&); // Don't implement
+	};
+
+private:
+	// Segment layout
+	struct Segment {
+		uint32_t magic;
+		uint32_t version;
+		std::atomic<uint64_t> seqlock; // odd while a snapshot is being written
+		PriceSnapshot snapshot;
+	};
+
+	static const uint32_t segmentMagic = 0x50524943; // "PRIC"
+	static const uint32_t segmentVersion = 1;
+
+	Segment* segment_;
+
+	PricePublisher(PricePublisher const&); // Don't Implement
+	void operator=(PricePublisher const&); // Don't implement
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline void trading::PricePublisher::publish(const trading::PriceSnapshot& snapshot) {
+	uint64_t seq = segment_->seqlock.load(std::memory_order_relaxed);
+	segment_->seqlock.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release); // odd sequence is visible before the data
+	segment_->snapshot = snapshot;
+	segment_->seqlock.store(seq + 2, std::memory_order_release);
+}
+
+inline bool trading::PricePublisher::Reader::read(trading::PriceSnapshot& snapshot) const {
+	const Segment* segment = static_cast<const Segment*>(segment_);
+	uint64_t before, after;
+	do {
+		before = segment->seqlock.load(std::memory_order_acquire);
+		snapshot = segment->snapshot;
+		std::atomic_thread_fence(std::memory_order_acquire); // data is read before the sequence is re-checked
+		after = segment->seqlock.load(std::memory_order_relaxed);
+	} while ((before & 1) != 0 || before != after);
+	return before != 0;
+}
+
+#endif /* PRICEPUBLISHER_H_ */
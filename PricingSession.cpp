@@ -0,0 +1,163 @@
+//==========================================================================
+// Name        : PricingSession.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Applies feed messages to one book and reports target-size costs
+//==========================================================================
+
+#include <iomanip>  // setprecision
+#include <sstream>
+
+#include "Journal.h"
+#include "Log.h"
+#include "Parser.h"
+#include "PricingSession.h"
+#include "ShadowVerifier.h"
+
+trading::PricingSession::PricingSession(OrderBook& book, const MarketOrder::Size& targetSize, std::ostream& out)
+	: book_(book), targetSize_(targetSize), out_(out), cachedBuyAmount_(0), cachedSellAmount_(0),
+	  prevTimestamp_(0), buySideChanged_(false), sellSideChanged_(false), publisher_(0), journal_(0), verifier_(0), amountsChanged_(false) {
+	out_ << std::setiosflags(std::ios::fixed); // to show amounts as XXXX.XX
+	book_.setTargetSize(targetSize_);
+}
+
+trading::Status trading::PricingSession::apply(const std::string& msg) {
+	MarketOrder order = MarketOrder(); // reduces leave side and price unset
+	OrderBook::Impact impact;
+
+	// Parse message
+	Status status = Parser::parse(msg, order);
+	if (status == success && order.timestamp < prevTimestamp_) { // out of order messages
+		status = outOfOrder;
+	}
+	if (status == success && journal_ && order.id.size() > Journal::maxIdLength) { // could not be journaled
+		status = badParse;
+	}
+	if (status != success) {
+		FILE_LOG(logERROR) << "Skipping this message due to parsing errors: " << msg;
+		counters_.record(status);
+		if (verifier_) {
+			verifier_->observe(msg, order, status);
+		}
+		return status;
+	}
+	prevTimestamp_ = order.timestamp;
+
+
+	// Submit the message to the order book
+	status = book_.processOrder(order, impact);
+	counters_.record(status);
+	if (status != success) {
+		FILE_LOG(logERROR) << "Error in order book when submitting the following order: " << order.toString();
+		if (verifier_) {
+			verifier_->observe(msg, order, status);
+		}
+		return status;
+	}
+	if (journal_) {
+		journal_->append(order);
+	}
+	FILE_LOG(logDEBUG) << "Result: " << book_.printBook();
+
+	if (impact.insideFillWindow) {
+		if (impact.side == sell) {
+			buySideChanged_ = true;
+		} else {
+			sellSideChanged_ = true;
+		}
+	}
+	if (verifier_) {
+		verifier_->observe(msg, order, success);
+		if (!repriceDue()) { // the displayed costs already hold for this message
+			verifier_->observeCosts(cachedBuyAmount_, cachedSellAmount_);
+		}
+	}
+	return success;
+}
+
+void trading::PricingSession::reprice() {
+	double newAmount = 0;
+	try {
+
+		// buy at market
+		if (buySideChanged_) {
+			newAmount = book_.pretendExecuteMarketOrder(buy, targetSize_);
+		}
+		if (buySideChanged_ && newAmount != cachedBuyAmount_) { // only display if newAmount changes
+			cachedBuyAmount_ = newAmount;
+			amountsChanged_ = true;
+			if (newAmount > 0) {
+				out_ << prevTimestamp_ << " B " << std::setprecision(2) << newAmount << std::endl;
+			} else { // newAmount = 0;
+				out_ << prevTimestamp_ << " B NA" << std::endl;
+			}
+		}
+
+
+		// sell at market
+		if (sellSideChanged_) {
+			newAmount = book_.pretendExecuteMarketOrder(sell, targetSize_);
+		}
+		if (sellSideChanged_ && newAmount != cachedSellAmount_) { // only display if newAmount changes
+			cachedSellAmount_ = newAmount;
+			amountsChanged_ = true;
+			if (newAmount > 0) {
+				out_ << prevTimestamp_ << " S " << std::setprecision(2) << newAmount << std::endl;
+			} else { // newAmount = 0;
+				out_ << prevTimestamp_ << " S NA" << std::endl;
+			}
+		}
+
+	} catch (const OrderBookException&) {
+		FILE_LOG(logERROR) << "Error while pretending to execute a market order at " << prevTimestamp_;
+	}
+
+	buySideChanged_ = false;
+	sellSideChanged_ = false;
+	if (verifier_) {
+		verifier_->observeCosts(cachedBuyAmount_, cachedSellAmount_);
+	}
+}
+
+void trading::PricingSession::publish() {
+	if (!publisher_ || (!amountsChanged_ && (book_.changes() & (OrderBook::bidTouchChanged | OrderBook::askTouchChanged)) == 0)) {
+		return;
+	}
+
+	PriceSnapshot snapshot = PriceSnapshot();
+	snapshot.sequence = counters_.count(success);
+	snapshot.timestamp = prevTimestamp_;
+	snapshot.targetSize = targetSize_;
+	snapshot.buyAmount = cachedBuyAmount_;
+	snapshot.sellAmount = cachedSellAmount_;
+	if (book_.hasBid()) {
+		snapshot.bestBidPrice = book_.bestBid().price;
+		snapshot.bestBidSize = book_.bestBid().size;
+	}
+	if (book_.hasAsk()) {
+		snapshot.bestAskPrice = book_.bestAsk().price;
+		snapshot.bestAskSize = book_.bestAsk().size;
+	}
+	snapshot.tickScale = MarketOrder::tickScale;
+	publisher_->publish(snapshot);
+
+	amountsChanged_ = false;
+	book_.clearChanges();
+}
+
+std::string trading::PricingSession::errorSummary() const {
+	if (counters_.errors() == 0) {
+		return std::string();
+	}
+
+	std::ostringstream oss;
+	oss << "Skipped " << counters_.errors() << " of " << counters_.errors() + counters_.count(success) << " messages:";
+	for (int i = success + 1; i < statusCount; i++) {
+		Status status = static_cast<Status>(i);
+		if (counters_.count(status) > 0) {
+			oss << " " << statusName(status) << "=" << counters_.count(status);
+		}
+	}
+	return oss.str();
+}
@@ -0,0 +1,134 @@
+//============================================================================
+// Name        : PricingSession.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Applies feed messages to one book and reports target-size costs
+//============================================================================
+
+#ifndef PRICINGSESSION_H_
+#define PRICINGSESSION_H_
+
+#include <ostream>
+#include <string>
+
+#include "Journal.h"
+#include "MarketOrder.h"
+#include "OrderBook.h"
+#include "PricePublisher.h"
+#include "Status.h"
+
+namespace trading {
+
+class ShadowVerifier;
+
+/**
+ * Pricing Session: parses messages, applies them to a book, and writes "<timestamp> B|S <amount>"
+ * whenever the cost of the target size changes. One session per book; not thread-safe.
+ */
+class PricingSession {
+public:
+	// The book must outlive the session; amounts are written to 'out' (switched to fixed notation)
+	PricingSession(OrderBook& book, const MarketOrder::Size& targetSize, std::ostream& out);
+
+	// Parse the message and submit it to the order book; anything but success means it was skipped
+	Status apply(const std::string& msg);
+
+	// Has an applied message possibly changed a cost since the last reprice()?
+	bool repriceDue() const;
+
+	// Pretend to execute the target size on the sides that may have changed and display new amounts
+	void reprice();
+
+	// Continue from a book restored as of 'timestamp': later messages are checked against it
+	// and both costs are due for repricing
+	void resumeAt(unsigned long int timestamp);
+
+	// Also publish results to shared memory (0 to stop); the publisher must outlive the session
+	void setPublisher(PricePublisher* publisher);
+
+	// Also journal every order the book accepts (0 to stop); the journal must outlive the session.
+	// While journaling, messages whose id is longer than Journal::maxIdLength are skipped as badParse.
+	void setJournal(Journal* journal);
+
+	// Also show every message and its outcome to a verifier (0 to stop); it must outlive the session
+	void setVerifier(ShadowVerifier* verifier);
+
+	// Publish costs, best bid/offer and sequence number if any of them moved since the last call
+	void publish();
+
+	// Timestamp of the last applied message
+	unsigned long int lastTimestamp() const;
+
+	// Messages seen, by status
+	const StatusCounters& counters() const;
+
+	// One-line breakdown of skipped messages (empty if none)
+	std::string errorSummary() const;
+
+	OrderBook& book();
+
+private:
+	OrderBook& book_;
+	MarketOrder::Size targetSize_;
+	std::ostream& out_;
+
+	double cachedBuyAmount_;
+	double cachedSellAmount_;
+
+	unsigned long int prevTimestamp_;
+	bool buySideChanged_;  // applied messages that may move the buy cost (asks) ...
+	bool sellSideChanged_; // ... or the sell cost (bids), not yet repriced
+
+	StatusCounters counters_;
+
+	PricePublisher* publisher_;
+	Journal* journal_;
+	ShadowVerifier* verifier_;
+	bool amountsChanged_; // since the last publish()
+
+	PricingSession(PricingSession const&); // Don't Implement
+	void operator=(PricingSession const&); // Don't implement
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline bool trading::PricingSession::repriceDue() const {
+	return buySideChanged_ || sellSideChanged_;
+}
+
+inline void trading::PricingSession::resumeAt(unsigned long int timestamp) {
+	prevTimestamp_ = timestamp;
+	buySideChanged_ = true;
+	sellSideChanged_ = true;
+}
+
+inline void trading::PricingSession::setPublisher(PricePublisher* publisher) {
+	publisher_ = publisher;
+	amountsChanged_ = true;
+}
+
+inline void trading::PricingSession::setJournal(Journal* journal) {
+	journal_ = journal;
+}
+
+inline void trading::PricingSession::setVerifier(ShadowVerifier* verifier) {
+	verifier_ = verifier;
+}
+
+inline unsigned long int trading::PricingSession::lastTimestamp() const {
+	return prevTimestamp_;
+}
+
+inline const trading::StatusCounters& trading::PricingSession::counters() const {
+	return counters_;
+}
+
+inline trading::OrderBook& trading::PricingSession::book() {
+	return book_;
+}
+
+#endif /* PRICINGSESSION_H_ */
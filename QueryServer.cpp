@@ -0,0 +1,277 @@
+//==========================================================================
+// Name        : QueryServer.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Local cost-to-trade query server on a Unix domain socket
+//==========================================================================
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Log.h"
+#include "QueryServer.h"
+
+namespace {
+
+uint64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+} // end of anonymous namespace
+
+trading::QueryServer::QueryServer(const std::string& path, PricingSession& session)
+	: path_(path), session_(session), listener_(-1), epoll_(-1), budget_(0), ticks_(0), answered_(0), totalLatencyNs_(0), maxLatencyNs_(0) {
+
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		throw BadQuerySocket();
+	}
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	epoll_ = epoll_create1(EPOLL_CLOEXEC);
+	unlink(path.c_str()); // stale socket from an earlier run
+	if (listener_ < 0 || epoll_ < 0 ||
+			bind(listener_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+			listen(listener_, SOMAXCONN) != 0) {
+		FILE_LOG(logERROR) << "Could not listen on " << path << ": " << std::strerror(errno);
+		if (listener_ >= 0) {
+			::close(listener_);
+		}
+		if (epoll_ >= 0) {
+			::close(epoll_);
+		}
+		throw BadQuerySocket();
+	}
+
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = listener_;
+	epoll_ctl(epoll_, EPOLL_CTL_ADD, listener_, &event);
+}
+
+trading::QueryServer::~QueryServer() {
+	while (!connections_.empty()) {
+		close(connections_.begin()->first);
+	}
+	::close(listener_);
+	::close(epoll_);
+	unlink(path_.c_str());
+}
+
+bool trading::QueryServer::watch(int fd) {
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+	if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0) {
+		FILE_LOG(logDEBUG) << "Cannot watch fd " << fd << ": " << std::strerror(errno);
+		return false;
+	}
+	watched_.push_back(fd);
+	return true;
+}
+
+bool trading::QueryServer::poll(int timeoutMs) {
+	enum { maxEvents = 64 };
+	struct epoll_event events[maxEvents];
+	bool watchedReady = false;
+
+	// Connections the last poll ran out of budget for go first
+	budget_ = answersPerPoll;
+	std::vector<int> owed(pending_.begin(), pending_.end());
+	pending_.clear();
+	for (std::size_t i = 0; i < owed.size(); i++) {
+		if (connections_.count(owed[i])) {
+			serve(owed[i]);
+		}
+	}
+
+	int n = epoll_wait(epoll_, events, maxEvents, pending_.empty() ? timeoutMs : 0);
+	for (int i = 0; i < n; i++) {
+		int fd = events[i].data.fd;
+		if (fd == listener_) {
+			accept();
+		} else if (std::find(watched_.begin(), watched_.end(), fd) != watched_.end()) {
+			watchedReady = true;
+		} else {
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+				read(fd);
+			}
+			if ((events[i].events & EPOLLOUT) && connections_.count(fd)) {
+				write(fd);
+			}
+		}
+	}
+	return watchedReady;
+}
+
+void trading::QueryServer::accept() {
+	while (true) {
+		int fd = accept4(listener_, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			return; // EAGAIN: no more pending connections
+		}
+		struct epoll_event event;
+		std::memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event);
+		connections_[fd] = Connection();
+		FILE_LOG(logDEBUG) << "Query client connected on fd " << fd;
+	}
+}
+
+void trading::QueryServer::read(int fd) {
+	Connection& connection = connections_[fd];
+	connection.readNs = nowNs();
+	char buffer[65536];
+	while (true) {
+		ssize_t n = ::read(fd, buffer, sizeof(buffer));
+		if (n > 0) {
+			connection.in.append(buffer, n);
+			if (connection.in.size() > maxInput) {
+				FILE_LOG(logERROR) << "Closing query client on fd " << fd << ": more than " << maxInput << " bytes unanswered";
+				close(fd);
+				return;
+			}
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n == 0) { // peer is done sending: answer what it sent, then close
+			connection.eof = true;
+			break;
+		}
+		close(fd); // error
+		return;
+	}
+	serve(fd);
+}
+
+void trading::QueryServer::serve(int fd) {
+	Connection& connection = connections_[fd];
+	if (!answer(connection)) {
+		FILE_LOG(logERROR) << "Closing query client on fd " << fd << ": batch too large";
+		close(fd);
+		return;
+	}
+	if (budget_ == 0) {
+		pending_.insert(fd);
+	}
+	write(fd);
+}
+
+bool trading::QueryServer::answer(Connection& connection) {
+	std::size_t used = 0;
+	while (budget_ > 0 && connection.in.size() - used >= sizeof(uint32_t)) {
+		uint32_t count;
+		std::memcpy(&count, connection.in.data() + used, sizeof(count));
+		if (count > maxBatch) {
+			return false;
+		}
+		std::size_t bytes = sizeof(count) + count * sizeof(QueryRequest);
+		if (connection.in.size() - used < bytes) {
+			break; // wait for the rest of the batch
+		}
+
+		const char* requests = connection.in.data() + used + sizeof(count);
+		if (connection.done == 0) { // a new batch: its count goes out first
+			connection.out.append(reinterpret_cast<const char*>(&count), sizeof(count));
+			connection.batchNs = connection.readNs;
+		}
+
+		uint32_t end = static_cast<uint32_t>(std::min<unsigned long int>(count, connection.done + budget_));
+		std::size_t start = connection.out.size();
+		connection.out.resize(start + (end - connection.done) * sizeof(QueryResponse));
+
+		uint64_t sequence = session_.counters().count(success);
+		for (uint32_t i = connection.done; i < end; i++) {
+			QueryRequest request;
+			std::memcpy(&request, requests + i * sizeof(QueryRequest), sizeof(request));
+
+			QueryResponse response;
+			std::memset(&response, 0, sizeof(response));
+			response.id = request.id;
+			response.side = request.side;
+			response.size = request.size;
+			response.sequence = sequence;
+			if ((request.side != 'B' && request.side != 'S') || request.size < 1) {
+				response.status = QueryResponse::badRequest;
+			} else {
+				response.amount = session_.book().pretendExecuteMarketOrder(request.side == 'B' ? buy : sell, request.size);
+				response.status = (response.amount > 0) ? QueryResponse::ok : QueryResponse::notEnoughInterest;
+			}
+			response.latencyNs = nowNs() - connection.batchNs;
+
+			answered_++;
+			totalLatencyNs_ += response.latencyNs;
+			maxLatencyNs_ = std::max(maxLatencyNs_, response.latencyNs);
+			std::memcpy(&connection.out[start + (i - connection.done) * sizeof(QueryResponse)], &response, sizeof(response));
+		}
+		budget_ -= end - connection.done;
+		if (end < count) { // out of budget: the rest of this batch waits for the next poll
+			connection.done = end;
+			break;
+		}
+		connection.done = 0;
+		used += bytes;
+	}
+	connection.in.erase(0, used);
+	return true;
+}
+
+void trading::QueryServer::write(int fd) {
+	Connection& connection = connections_[fd];
+	std::size_t written = 0;
+	while (written < connection.out.size()) {
+		ssize_t n = ::send(fd, connection.out.data() + written, connection.out.size() - written, MSG_NOSIGNAL);
+		if (n > 0) {
+			written += n;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else {
+			close(fd);
+			return;
+		}
+	}
+	connection.out.erase(0, written);
+	if (connection.eof && connection.out.empty() && !pending_.count(fd)) { // everything it sent is answered
+		close(fd);
+		return;
+	}
+
+	// Ask for EPOLLOUT only while answers are pending, and for EPOLLIN until the client is done
+	struct epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = (connection.eof ? static_cast<uint32_t>(0) : static_cast<uint32_t>(EPOLLIN)) |
+			(connection.out.empty() ? static_cast<uint32_t>(0) : static_cast<uint32_t>(EPOLLOUT));
+	event.data.fd = fd;
+	epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &event);
+}
+
+void trading::QueryServer::close(int fd) {
+	epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, 0);
+	::close(fd);
+	connections_.erase(fd);
+	pending_.erase(fd);
+	FILE_LOG(logDEBUG) << "Query client on fd " << fd << " disconnected";
+}
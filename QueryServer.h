@@ -0,0 +1,151 @@
+//============================================================================
+// Name        : QueryServer.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Local cost-to-trade query server on a Unix domain socket
+//============================================================================
+
+#ifndef QUERYSERVER_H_
+#define QUERYSERVER_H_
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Exceptions.h"
+#include "PricingSession.h"
+
+namespace trading {
+
+/*
+ * Wire format (host byte order). A client sends batches:
+ *   uint32_t count, then count QueryRequest
+ * and gets back, for each batch, in order:
+ *   uint32_t count, then count QueryResponse
+ */
+
+struct QueryRequest {
+	uint32_t id;      // echoed back
+	uint8_t side;     // 'B' (cost to buy) or 'S' (proceeds from selling)
+	uint8_t pad[3];
+	uint64_t size;    // shares
+};
+
+struct QueryResponse {
+	enum Status { ok = 0, notEnoughInterest = 1, badRequest = 2 };
+
+	uint32_t id;
+	uint8_t side;
+	uint8_t status;
+	uint8_t pad[2];
+	uint64_t size;
+	double amount;      // 0 unless status is ok
+	uint64_t sequence;  // messages applied to the book when the answer was computed
+	uint64_t latencyNs; // from receipt of the batch to this answer
+};
+
+/**
+ * Query Server: non-blocking, epoll-driven. It runs on the ingest thread between messages
+ * (see poll and tick), so ingest never waits on a lock. Each poll answers at most
+ * answersPerPoll requests and leaves the rest for the next one, so a big batch may span
+ * several messages; every response's sequence says which book it saw.
+ */
+class QueryServer {
+public:
+	enum {
+		maxBatch = 65536,      // largest batch accepted; bigger ones close the connection
+		maxInput = 4 << 20,    // unanswered bytes held per client; more closes the connection
+		answersPerPoll = 4096, // requests answered per poll at most
+		pollEvery = 64         // messages per poll from tick()
+	};
+
+	// Listen on 'path' (replacing a stale socket file); throws BadQuerySocket
+	QueryServer(const std::string& path, PricingSession& session);
+
+	// Closes every connection and removes the socket file
+	~QueryServer();
+
+	// Also wake poll() when 'fd' becomes readable (e.g. the feed), without reading it; false if
+	// 'fd' cannot be watched (e.g. a regular file, which is always readable)
+	bool watch(int fd);
+
+	// Serve whatever is ready, waiting up to 'timeoutMs' (-1 = until something happens, 0 = not at all;
+	// never waits while answers are owed). Returns true if a watched descriptor is readable.
+	bool poll(int timeoutMs);
+
+	// Call once per message: poll(0) every pollEvery calls, so ingest makes no syscall for the rest
+	void tick();
+
+	// Requests answered, and their mean and worst latency
+	unsigned long int answered() const;
+	double meanLatencyNs() const;
+	uint64_t maxLatencyNs() const;
+
+private:
+	struct Connection {
+		std::string in;      // bytes received, not yet answered
+		std::string out;     // answers not yet written
+		uint64_t readNs;     // time of the last read
+		uint64_t batchNs;    // when the batch at the front of 'in' was read ...
+		uint32_t done;       // ... and how many of its requests are answered
+		bool eof;            // the client will send nothing more; close once it is answered
+	};
+
+	void accept();
+	void read(int fd);
+	void write(int fd);
+	void close(int fd);
+
+	// Answer the connection's complete batches within budget_, write the answers and keep
+	// it in pending_ if the budget ran out; closes it on a batch that is too large
+	void serve(int fd);
+
+	// Answer complete batches in the connection's input until budget_ runs out; false if a
+	// batch is too large
+	bool answer(Connection& connection);
+
+	std::string path_;
+	PricingSession& session_;
+	int listener_;
+	int epoll_;
+	std::vector<int> watched_;
+	std::map<int, Connection> connections_;
+	std::set<int> pending_;   // connections that may hold requests the last poll had no budget for
+	unsigned long int budget_; // requests this poll may still answer
+	unsigned long int ticks_;
+
+	unsigned long int answered_;
+	uint64_t totalLatencyNs_;
+	uint64_t maxLatencyNs_;
+
+	QueryServer(QueryServer const&);     // Don't Implement
+	void operator=(QueryServer const&);  // Don't implement
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline void trading::QueryServer::tick() {
+	if (++ticks_ % pollEvery == 0) {
+		poll(0);
+	}
+}
+
+inline unsigned long int trading::QueryServer::answered() const {
+	return answered_;
+}
+
+inline double trading::QueryServer::meanLatencyNs() const {
+	return answered_ ? static_cast<double>(totalLatencyNs_) / answered_ : 0;
+}
+
+inline uint64_t trading::QueryServer::maxLatencyNs() const {
+	return maxLatencyNs_;
+}
+
+#endif /* QUERYSERVER_H_ */
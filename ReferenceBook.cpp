@@ -0,0 +1,101 @@
+//==========================================================================
+// Name        : ReferenceBook.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Deliberately simple order book to check the Pricer's book against
+//==========================================================================
+
+#include <algorithm>
+
+#include "ReferenceBook.h"
+
+trading::ReferenceBook::ReferenceBook() : openBids_(0), openAsks_(0) {
+}
+
+trading::Status trading::ReferenceBook::processOrder(const MarketOrder& order) {
+	switch (order.type) {
+	case add: {
+		if (order.side != buy && order.side != sell) {
+			return badOrderSide;
+		}
+		Orders& orders = (order.side == buy) ? bidOrders_ : askOrders_;
+		if (orders.count(order.id) > 0) {
+			return duplicateOrderId;
+		}
+		Resting resting = { order.price, order.size };
+		orders[order.id] = resting;
+		((order.side == buy) ? bids_ : asks_)[order.price] += order.size;
+		((order.side == buy) ? openBids_ : openAsks_) += order.size;
+		return success;
+	}
+	case reduce: { // bids are searched first, as in the Pricer's book
+		Orders::iterator it = bidOrders_.find(order.id);
+		if (it != bidOrders_.end()) {
+			take(bids_, bidOrders_, openBids_, it, order.size);
+			return success;
+		}
+		it = askOrders_.find(order.id);
+		if (it != askOrders_.end()) {
+			take(asks_, askOrders_, openAsks_, it, order.size);
+			return success;
+		}
+		return reduceNonexistentOrder;
+	}
+	default:
+		return badOrderType;
+	}
+}
+
+void trading::ReferenceBook::take(Levels& levels, Orders& orders, MarketOrder::Size& total, Orders::iterator it, const MarketOrder::Size& size) {
+	MarketOrder::Size taken = std::min(size, it->second.size);
+	total -= taken;
+	Levels::iterator level = levels.find(it->second.price);
+	level->second -= taken;
+	if (level->second == 0) {
+		levels.erase(level);
+	}
+	it->second.size -= taken;
+	if (it->second.size == 0) {
+		orders.erase(it);
+	}
+}
+
+trading::ReferenceBook::Level trading::ReferenceBook::best(const OrderSide& side) const {
+	Level level = { 0, 0 };
+	if (side == buy && !bids_.empty()) {
+		level.price = bids_.rbegin()->first;
+		level.size = bids_.rbegin()->second;
+	} else if (side == sell && !asks_.empty()) {
+		level.price = asks_.begin()->first;
+		level.size = asks_.begin()->second;
+	}
+	return level;
+}
+
+trading::MarketOrder::Size trading::ReferenceBook::openInterest(const OrderSide& side) const {
+	return (side == buy) ? openBids_ : openAsks_;
+}
+
+double trading::ReferenceBook::cost(const OrderSide& side, const MarketOrder::Size& targetSize) const {
+	if (openInterest(side == buy ? sell : buy) < targetSize) { // not possible to execute
+		return 0;
+	}
+
+	MarketOrder::Size left = targetSize;
+	double amount = 0;
+	if (side == buy) { // cheapest asks first
+		for (Levels::const_iterator it = asks_.begin(); left > 0; it++) {
+			MarketOrder::Size taken = std::min(left, it->second);
+			amount += taken * (static_cast<double>(it->first) / MarketOrder::tickScale);
+			left -= taken;
+		}
+	} else { // highest bids first
+		for (Levels::const_reverse_iterator it = bids_.rbegin(); left > 0; it++) {
+			MarketOrder::Size taken = std::min(left, it->second);
+			amount += taken * (static_cast<double>(it->first) / MarketOrder::tickScale);
+			left -= taken;
+		}
+	}
+	return amount;
+}
@@ -0,0 +1,72 @@
+//============================================================================
+// Name        : ReferenceBook.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Deliberately simple order book to check the Pricer's book against
+//============================================================================
+
+#ifndef REFERENCEBOOK_H_
+#define REFERENCEBOOK_H_
+
+#include <map>
+
+#include "MarketOrder.h"
+#include "Status.h"
+
+namespace trading {
+
+/**
+ * Reference Book: shares no code with BasicOrderBook. Each side is a std::map of price to the
+ * total size resting there plus a std::map of id to its order, and a running total per side.
+ * Best prices and costs are read off the levels on every call: simple rather than fast.
+ */
+class ReferenceBook {
+public:
+	// Aggregated price level; price 0 = empty side
+	struct Level {
+		MarketOrder::Price price;
+		MarketOrder::Size size;
+	};
+
+	ReferenceBook();
+
+	// Apply one parsed message, with the same statuses as the Pricer's book
+	Status processOrder(const MarketOrder& order);
+
+	// Highest bid or lowest ask
+	Level best(const OrderSide& side) const;
+
+	// Total size resting on one side
+	MarketOrder::Size openInterest(const OrderSide& side) const;
+
+	// Cost of buying (side buy, from the asks) or proceeds of selling (side sell, into the
+	// bids) 'targetSize' shares at market; 0 if the side cannot fill it
+	double cost(const OrderSide& side, const MarketOrder::Size& targetSize) const;
+
+private:
+	struct Resting {
+		MarketOrder::Price price;
+		MarketOrder::Size size;
+	};
+
+	typedef std::map<MarketOrder::Price,MarketOrder::Size> Levels; // ascending prices
+	typedef std::map<MarketOrder::Id,Resting> Orders;
+
+	// Take 'size' off the order at 'it' and its level, dropping either once empty
+	static void take(Levels& levels, Orders& orders, MarketOrder::Size& total, Orders::iterator it, const MarketOrder::Size& size);
+
+	Levels bids_;
+	Levels asks_;
+	Orders bidOrders_; // ids are unique per side, as in the Pricer's book
+	Orders askOrders_;
+	MarketOrder::Size openBids_;
+	MarketOrder::Size openAsks_;
+
+	ReferenceBook(ReferenceBook const&);  // Don't Implement
+	void operator=(ReferenceBook const&); // Don't implement
+};
+
+} // end of namespace
+
+#endif /* REFERENCEBOOK_H_ */
@@ -0,0 +1,195 @@
+//==========================================================================
+// Name        : ShadowVerifier.cpp
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Checks the Pricer's book against a reference book
+//==========================================================================
+
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include "Log.h"
+#include "ShadowVerifier.h"
+
+trading::ShadowVerifier::ShadowVerifier(OrderBook& book, const MarketOrder::Size& targetSize, unsigned long int sampleEvery)
+	: book_(book), targetSize_(targetSize), sampleEvery_(sampleEvery > 0 ? sampleEvery : 1), observed_(0), costsDue_(false), overflowedAt_(0),
+	  queue_(queueSize), verified_(0), costsVerified_(0), divergences_(0) {
+
+	std::vector<MarketOrder> orders;
+	book_.snapshot(orders);
+	for (std::size_t i = 0; i < orders.size(); i++) {
+		reference_.processOrder(orders[i]);
+	}
+
+	thread_ = std::thread(&ShadowVerifier::run, this);
+}
+
+trading::ShadowVerifier::~ShadowVerifier() {
+	if (thread_.joinable()) {
+		finish();
+	}
+}
+
+void trading::ShadowVerifier::observe(const std::string& msg, const MarketOrder& order, const Status& status) {
+	++observed_;
+	if (overflowedAt_ != 0) {
+		return;
+	}
+
+	Observation seen;
+	seen.number = observed_;
+	seen.costs = false;
+	seen.order = order;
+	seen.status = status;
+	seen.sampled = (observed_ % sampleEvery_ == 0);
+	if (seen.sampled) {
+		seen.msg = msg;
+		seen.bid.price = book_.hasBid() ? book_.bestBid().price : 0;
+		seen.bid.size = book_.hasBid() ? book_.bestBid().size : 0;
+		seen.ask.price = book_.hasAsk() ? book_.bestAsk().price : 0;
+		seen.ask.size = book_.hasAsk() ? book_.bestAsk().size : 0;
+		seen.openBids = book_.openInterest(buy);
+		seen.openAsks = book_.openInterest(sell);
+		costsDue_ = true;
+	}
+	if (!queue_.tryPush(std::move(seen))) { // the reference is too far behind to catch up
+		overflowedAt_ = observed_;
+	}
+}
+
+void trading::ShadowVerifier::observeCosts(double buyAmount, double sellAmount) {
+	if (!costsDue_ || overflowedAt_ != 0) {
+		return;
+	}
+	costsDue_ = false;
+
+	Observation seen;
+	seen.number = observed_;
+	seen.costs = true;
+	seen.buyCost = buyAmount;
+	seen.sellCost = sellAmount;
+	if (!queue_.tryPush(std::move(seen))) {
+		overflowedAt_ = observed_;
+	}
+}
+
+std::string trading::ShadowVerifier::finish() {
+	if (thread_.joinable()) {
+		Observation stop;
+		stop.number = 0;
+		stop.costs = false;
+		queue_.push(std::move(stop));
+		thread_.join();
+	}
+
+	std::ostringstream oss;
+	oss << "Verified " << verified_ << " of " << observed_ << " messages and " << costsVerified_ << " costs against the reference book: ";
+	if (divergences_ == 0) {
+		oss << "no divergence";
+	} else {
+		oss << divergences_ << " divergent, first " << firstDivergence_;
+	}
+	if (overflowedAt_ != 0) {
+		oss << "; stopped at message " << overflowedAt_ << ", the reference fell behind";
+	}
+	return oss.str();
+}
+
+void trading::ShadowVerifier::run() {
+	Observation seen;
+
+	unsigned int idle = 0;
+	while (true) {
+		if (!queue_.pop(seen)) { // spin briefly, then back off while the feed is quiet
+			if (++idle < 64) {
+				std::this_thread::yield();
+			} else {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+			continue;
+		}
+		idle = 0;
+		if (seen.number == 0) {
+			return;
+		}
+
+		// The reference has replayed every message up to this one by now
+		std::string why;
+		if (seen.costs) {
+			costsVerified_++;
+			why = compareCosts(seen);
+			if (!why.empty() && divergences_++ == 0) {
+				std::ostringstream oss;
+				oss << "after message " << seen.number << ": " << why;
+				firstDivergence_ = oss.str();
+				FILE_LOG(logERROR) << "Reference book diverges " << firstDivergence_;
+			}
+			continue;
+		}
+
+		// Rejected before reaching the book: nothing to replay
+		Status status = seen.status;
+		if (status != badParse && status != outOfOrder) {
+			status = reference_.processOrder(seen.order);
+		}
+
+		if (!seen.sampled && status == seen.status) {
+			continue;
+		}
+		verified_ += seen.sampled ? 1 : 0;
+		why = compare(seen, status);
+		if (!why.empty() && divergences_++ == 0) {
+			std::ostringstream oss;
+			oss << "at message " << seen.number << " \"" << (seen.sampled ? seen.msg : seen.order.toString()) << "\": " << why;
+			firstDivergence_ = oss.str();
+			FILE_LOG(logERROR) << "Reference book diverges " << firstDivergence_;
+		}
+	}
+}
+
+std::string trading::ShadowVerifier::compare(const Observation& seen, const Status& status) {
+	std::ostringstream oss;
+	if (status != seen.status) {
+		oss << "status " << statusName(seen.status) << ", reference " << statusName(status) << "; ";
+	}
+	if (!seen.sampled) {
+		return oss.str();
+	}
+
+	ReferenceBook::Level bid = reference_.best(buy);
+	ReferenceBook::Level ask = reference_.best(sell);
+	if (bid.price != seen.bid.price || bid.size != seen.bid.size) {
+		oss << "best bid " << seen.bid.size << "@" << seen.bid.price << ", reference " << bid.size << "@" << bid.price << "; ";
+	}
+	if (ask.price != seen.ask.price || ask.size != seen.ask.size) {
+		oss << "best ask " << seen.ask.size << "@" << seen.ask.price << ", reference " << ask.size << "@" << ask.price << "; ";
+	}
+	MarketOrder::Size openBids = reference_.openInterest(buy);
+	MarketOrder::Size openAsks = reference_.openInterest(sell);
+	if (openBids != seen.openBids || openAsks != seen.openAsks) {
+		oss << "open interest " << seen.openBids << "/" << seen.openAsks << ", reference " << openBids << "/" << openAsks << "; ";
+	}
+
+	std::string why = oss.str();
+	return why.empty() ? why : why.substr(0, why.size() - 2);
+}
+
+std::string trading::ShadowVerifier::compareCosts(const Observation& seen) {
+	std::ostringstream oss;
+
+	// Costs agree to the tick: the books sum orders and levels in different orders
+	double buyCost = reference_.cost(buy, targetSize_);
+	double sellCost = reference_.cost(sell, targetSize_);
+	if (std::llround(buyCost * MarketOrder::tickScale) != std::llround(seen.buyCost * MarketOrder::tickScale)) {
+		oss << "buy cost " << seen.buyCost << ", reference " << buyCost << "; ";
+	}
+	if (std::llround(sellCost * MarketOrder::tickScale) != std::llround(seen.sellCost * MarketOrder::tickScale)) {
+		oss << "sell cost " << seen.sellCost << ", reference " << sellCost << "; ";
+	}
+
+	std::string why = oss.str();
+	return why.empty() ? why : why.substr(0, why.size() - 2);
+}
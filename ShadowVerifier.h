@@ -0,0 +1,102 @@
+//============================================================================
+// Name        : ShadowVerifier.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Checks the Pricer's book against a reference book
+//============================================================================
+
+#ifndef SHADOWVERIFIER_H_
+#define SHADOWVERIFIER_H_
+
+#include <string>
+#include <thread>
+
+#include "MarketOrder.h"
+#include "OrderBook.h"
+#include "ReferenceBook.h"
+#include "SpscQueue.h"
+#include "Status.h"
+
+namespace trading {
+
+/**
+ * Shadow Verifier: replays every message the session applies into a ReferenceBook on its own
+ * thread and compares status, best bid/offer and open interest with what the Pricer's book
+ * showed after the same message, on every 'sampleEvery'-th message (1 = all of them). The
+ * session's displayed costs are compared at the next point they are current after a sampled
+ * message, which also checks that the session repriced every side that changed. The book
+ * thread only copies what it saw into a queue and never waits on it: if the reference falls
+ * queueSize observations behind, verification stops and finish() says so.
+ */
+class ShadowVerifier {
+public:
+	enum { queueSize = 1 << 16 };
+
+	// Starts from a copy of 'book' (e.g. restored with --from or --recover)
+	ShadowVerifier(OrderBook& book, const MarketOrder::Size& targetSize, unsigned long int sampleEvery);
+
+	// Drains the queue and joins the reference thread
+	~ShadowVerifier();
+
+	// Book thread: record 'order' as parsed from 'msg' (only kept for sampled messages), the
+	// status the session gave it, and the book as it is now
+	void observe(const std::string& msg, const MarketOrder& order, const Status& status);
+
+	// Book thread: the session's costs, current as of the last observed message; only
+	// recorded if a sampled message was observed since the last call
+	void observeCosts(double buyAmount, double sellAmount);
+
+	// Book thread: wait for the reference to catch up; returns e.g.
+	// "Verified 1000 of 200000 messages and 950 costs against the reference book: no divergence",
+	// or "...: stopped at message 1234, the reference fell behind" after an overflow
+	std::string finish();
+
+private:
+	// What the Pricer's book showed after one message, or the session's costs after it
+	struct Observation {
+		unsigned long int number; // 1-based message number, 0 = stop
+		bool costs;               // only the costs below are filled in
+		MarketOrder order;
+		std::string msg;          // sampled messages only
+		Status status;
+		bool sampled;             // are the book fields below filled in?
+		OrderBook::Level bid;     // price 0 = no bids
+		OrderBook::Level ask;     // price 0 = no asks
+		MarketOrder::Size openBids;
+		MarketOrder::Size openAsks;
+		double buyCost;
+		double sellCost;
+	};
+
+	// Reference thread
+	void run();
+
+	// Why the reference disagrees with 'seen' (empty if it does not)
+	std::string compare(const Observation& seen, const Status& status);
+
+	// Why the reference's costs disagree with the session's (empty if they do not)
+	std::string compareCosts(const Observation& seen);
+
+	OrderBook& book_;
+	MarketOrder::Size targetSize_;
+	unsigned long int sampleEvery_;
+	unsigned long int observed_; // book thread
+	bool costsDue_;              // book thread: a sampled message since the last observeCosts
+	unsigned long int overflowedAt_; // book thread: message that found the queue full (0 = none)
+
+	ReferenceBook reference_;        // reference thread only, after construction
+	SpscQueue<Observation> queue_;
+	unsigned long int verified_;     // reference thread, read after join
+	unsigned long int costsVerified_;
+	unsigned long int divergences_;
+	std::string firstDivergence_;
+	std::thread thread_;
+
+	ShadowVerifier(ShadowVerifier const&);  // Don't Implement
+	void operator=(ShadowVerifier const&);  // Don't implement
+};
+
+} // end of namespace
+
+#endif /* SHADOWVERIFIER_H_ */
@@ -0,0 +1,97 @@
+//============================================================================
+// Name        : SpscQueue.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Bounded single-producer single-consumer queue
+//============================================================================
+
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace trading {
+
+/**
+ * Bounded lock-free ring between exactly one producer thread and one consumer thread.
+ * Head and tail live on separate cache lines; each side only writes its own index.
+ */
+template <typename T>
+class SpscQueue {
+public:
+	// Capacity is rounded up to a power of two
+	explicit SpscQueue(std::size_t capacity);
+
+	// Producer: enqueue, yielding while the queue is full
+	void push(T&& item);
+
+	// Producer: enqueue; false (leaving 'item' alone) if the queue is full
+	bool tryPush(T&& item);
+
+	// Consumer: dequeue into 'item'; false if the queue is empty
+	bool pop(T& item);
+
+private:
+	std::vector<T> slots_;
+	std::size_t mask_;
+
+	alignas(64) std::atomic<std::size_t> head_; // next slot to pop (consumer)
+	alignas(64) std::atomic<std::size_t> tail_; // next slot to push (producer)
+
+	SpscQueue(SpscQueue const&);      // Don't Implement
+	void operator=(SpscQueue const&); // Don't implement
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+template <typename T>
+inline trading::SpscQueue<T>::SpscQueue(std::size_t capacity) : head_(0), tail_(0) {
+	std::size_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	slots_.resize(size);
+	mask_ = size - 1;
+}
+
+template <typename T>
+inline void trading::SpscQueue<T>::push(T&& item) {
+	std::size_t tail = tail_.load(std::memory_order_relaxed);
+	while (tail - head_.load(std::memory_order_acquire) > mask_) { // full: let the consumer catch up
+		std::this_thread::yield();
+	}
+	slots_[tail & mask_] = std::move(item);
+	tail_.store(tail + 1, std::memory_order_release);
+}
+
+template <typename T>
+inline bool trading::SpscQueue<T>::tryPush(T&& item) {
+	std::size_t tail = tail_.load(std::memory_order_relaxed);
+	if (tail - head_.load(std::memory_order_acquire) > mask_) {
+		return false;
+	}
+	slots_[tail & mask_] = std::move(item);
+	tail_.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+inline bool trading::SpscQueue<T>::pop(T& item) {
+	std::size_t head = head_.load(std::memory_order_relaxed);
+	if (head == tail_.load(std::memory_order_acquire)) {
+		return false;
+	}
+	item = std::move(slots_[head & mask_]);
+	head_.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+#endif /* SPSCQUEUE_H_ */
@@ -0,0 +1,114 @@
+//============================================================================
+// Name        : Status.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Status codes for the exception-free message path
+//============================================================================
+
+#ifndef STATUS_H_
+#define STATUS_H_
+
+#include "Exceptions.h"
+
+namespace trading {
+
+// Result of parsing or applying one message; each error mirrors an exception class
+enum Status {
+	success,
+	badParse,               // BadParse
+	outOfOrder,             // OutOfOrder
+	badTicker,              // BadTicker
+	badOrderType,           // BadOrderType
+	badOrderSide,           // BadOrderSide
+	badOrderSize,           // BadOrderSize
+	duplicateOrderId,       // DuplicateOrderId
+	reduceNonexistentOrder, // AttempToReduceNonexistantOrder
+	statusCount
+};
+
+// Human-readable status name
+const char* statusName(const Status& status);
+
+// Throw the exception matching an error status (no-op on success)
+void throwOnError(const Status& status);
+
+/**
+ * Per-status message counters
+ */
+class StatusCounters {
+public:
+	StatusCounters();
+
+	// Count one message with this status
+	void record(const Status& status);
+
+	// Messages seen with this status
+	unsigned long int count(const Status& status) const;
+
+	// Messages seen with any error status
+	unsigned long int errors() const;
+
+private:
+	unsigned long int counts_[statusCount];
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline const char* trading::statusName(const trading::Status& status) {
+	static const char* const names[] = {"success", "badParse", "outOfOrder", "badTicker", "badOrderType",
+			"badOrderSide", "badOrderSize", "duplicateOrderId", "reduceNonexistentOrder"};
+	return (status < statusCount) ? names[status] : "unknown";
+}
+
+inline void trading::throwOnError(const trading::Status& status) {
+	switch (status) {
+	case success:
+		return;
+	case badParse:
+		throw BadParse();
+	case outOfOrder:
+		throw OutOfOrder();
+	case badTicker:
+		throw BadTicker();
+	case badOrderType:
+		throw BadOrderType();
+	case badOrderSide:
+		throw BadOrderSide();
+	case badOrderSize:
+		throw BadOrderSize();
+	case duplicateOrderId:
+		throw DuplicateOrderId();
+	case reduceNonexistentOrder:
+		throw AttempToReduceNonexistantOrder();
+	default:
+		throw Exception();
+	}
+}
+
+inline trading::StatusCounters::StatusCounters() {
+	for (int i = 0; i < statusCount; i++) {
+		counts_[i] = 0;
+	}
+}
+
+inline void trading::StatusCounters::record(const trading::Status& status) {
+	counts_[status]++;
+}
+
+inline unsigned long int trading::StatusCounters::count(const trading::Status& status) const {
+	return counts_[status];
+}
+
+inline unsigned long int trading::StatusCounters::errors() const {
+	unsigned long int total = 0;
+	for (int i = success + 1; i < statusCount; i++) {
+		total += counts_[i];
+	}
+	return total;
+}
+
+#endif /* STATUS_H_ */
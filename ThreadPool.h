@@ -0,0 +1,179 @@
+//============================================================================
+// Name        : ThreadPool.h
+// Author      : Gleb Chuvpilo
+// Version     : 1.0
+// Copyright   : (c) Gleb Chuvpilo, 2012
+// Description : Work-stealing thread pool
+//============================================================================
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace trading {
+
+/**
+ * Work-stealing thread pool: each worker runs tasks from the back of its own deque and,
+ * when that is empty, steals from the front of the others'. Tasks must not throw.
+ */
+class ThreadPool {
+public:
+	typedef std::function<void()> Task;
+
+	// Start 'threads' workers (at least one)
+	explicit ThreadPool(std::size_t threads);
+
+	// Runs the remaining tasks, then joins the workers
+	~ThreadPool();
+
+	// Queue a task; tasks are dealt round-robin across the workers' deques
+	void submit(const Task& task);
+
+	// Block until every submitted task has finished
+	void wait();
+
+	std::size_t size() const;
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void run(std::size_t self);
+	bool take(std::size_t self, Task& task);
+
+	std::vector<std::unique_ptr<Worker> > workers_;
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;              // guards the counters below
+	std::condition_variable wake_;  // new work or stopping
+	std::condition_variable idle_;  // all work done
+	std::size_t queued_;            // submitted, not yet taken
+	std::size_t pending_;           // submitted, not yet finished
+	std::size_t next_;              // round-robin cursor
+	bool stopping_;
+
+	ThreadPool(ThreadPool const&);      // Don't Implement
+	void operator=(ThreadPool const&);  // Don't implement
+};
+
+} // end of namespace
+
+
+// Definitions of inline functions
+
+inline trading::ThreadPool::ThreadPool(std::size_t threads)
+	: queued_(0), pending_(0), next_(0), stopping_(false) {
+	if (threads < 1) {
+		threads = 1;
+	}
+	for (std::size_t i = 0; i < threads; i++) {
+		workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+	for (std::size_t i = 0; i < threads; i++) {
+		threads_.push_back(std::thread(&ThreadPool::run, this, i));
+	}
+}
+
+inline trading::ThreadPool::~ThreadPool() {
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_all();
+	for (std::size_t i = 0; i < threads_.size(); i++) {
+		threads_[i].join();
+	}
+}
+
+inline void trading::ThreadPool::submit(const Task& task) {
+	std::size_t target;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		target = next_++ % workers_.size();
+		pending_++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+		workers_[target]->tasks.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queued_++;
+	}
+	wake_.notify_one();
+}
+
+inline void trading::ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (pending_ > 0) {
+		idle_.wait(lock);
+	}
+}
+
+inline std::size_t trading::ThreadPool::size() const {
+	return workers_.size();
+}
+
+inline bool trading::ThreadPool::take(std::size_t self, Task& task) {
+	// Own deque first, newest task (still warm in cache)
+	{
+		Worker& own = *workers_[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	// Steal the oldest task from the others
+	for (std::size_t i = 1; i < workers_.size(); i++) {
+		Worker& victim = *workers_[(self + i) % workers_.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void trading::ThreadPool::run(std::size_t self) {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (queued_ == 0 && !stopping_) {
+				wake_.wait(lock);
+			}
+			if (queued_ == 0) { // stopping and nothing left
+				return;
+			}
+			queued_--; // a task is reserved for us; some deque holds it
+		}
+
+		Task task;
+		while (!take(self, task)) {
+			std::this_thread::yield(); // the reserved task is still being pushed
+		}
+		task();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (--pending_ == 0) {
+			idle_.notify_all();
+		}
+	}
+}
+
+#endif /* THREADPOOL_H_ */
@@ -6,6 +6,7 @@
 // Description : Various utilities
 //==========================================================================
 
+#include <cstdlib>
 #include <fstream>
 #include <vector>
 
@@ -16,11 +17,15 @@
 namespace trading {
 
 std::vector<std::string> readFile2Vector(const std::string& filename) {
-	FILE_LOG(logDEBUG) << "Opening file " << filename.c_str();
+	return readFile2Vector(filename, 0);
+}
+
+std::vector<std::string> readFile2Vector(const std::string& filename, const std::streamoff& offset) {
+	FILE_LOG(logDEBUG) << "Opening file " << filename.c_str() << " at offset " << offset;
 
 	std::ifstream is(filename.c_str());
 
-	if (!is) {
+	if (!is || !is.seekg(offset)) {
 		throw trading::BadMarketDataFile();
 	}
 
@@ -38,4 +43,16 @@ std::vector<std::string> readFile2Vector(const std::string& filename) {
 	return lines;
 }
 
+unsigned long int parseTimeOfDay(const std::string& str) {
+	if (str.find(':') == std::string::npos) {
+		return std::strtoul(str.c_str(), 0, 10);
+	}
+
+	std::vector<std::string> fields = tokenize(str, ':');
+	unsigned long int hours = std::strtoul(fields.at(0).c_str(), 0, 10);
+	unsigned long int minutes = (fields.size() > 1) ? std::strtoul(fields[1].c_str(), 0, 10) : 0;
+	double seconds = (fields.size() > 2) ? std::atof(fields[2].c_str()) : 0;
+	return ((hours * 60 + minutes) * 60) * 1000 + static_cast<unsigned long int>(seconds * 1000 + 0.5);
+}
+
 }
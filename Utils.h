@@ -21,6 +21,12 @@ namespace trading {
 // Read file to a vector of strings (each one is a line)
 std::vector<std::string> readFile2Vector(const std::string& filename);
 
+// Same, starting at byte 'offset'
+std::vector<std::string> readFile2Vector(const std::string& filename, const std::streamoff& offset);
+
+// Milliseconds since midnight from "28800000" or "HH:MM[:SS[.mmm]]"
+unsigned long int parseTimeOfDay(const std::string& str);
+
 // Basic tokenizer
 std::vector<std::string> tokenize(const std::string& str, const char& delimiter);
 
@@ -0,0 +1,130 @@
+#!/bin/sh
+#============================================================================
+# Name        : run.sh
+# Author      : Gleb Chuvpilo
+# Version     : 1.0
+# Copyright   : (c) Gleb Chuvpilo, 2012
+# Description : Regression tests for Pricer (run from the top directory: make test)
+#============================================================================
+
+PRICER=${PRICER:-./Pricer}
+FEEDS=tests/feeds
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+failures=0
+
+pass() {
+	echo "PASS: $1"
+}
+
+fail() {
+	echo "FAIL: $1"
+	failures=$((failures + 1))
+}
+
+# Journaling the same feed twice, or in two halves joined by --recover, gives the same file
+test_journal_is_deterministic() {
+	head -1000 $FEEDS/mixed.txt > "$TMP/first.txt"
+	tail -n +1001 $FEEDS/mixed.txt > "$TMP/second.txt"
+	$PRICER --journal "$TMP/once.jnl" 200 < $FEEDS/mixed.txt > /dev/null 2>&1
+	$PRICER --journal "$TMP/again.jnl" 200 < $FEEDS/mixed.txt > /dev/null 2>&1
+	$PRICER --journal "$TMP/halves.jnl" 200 < "$TMP/first.txt" > /dev/null 2>&1
+	$PRICER --recover "$TMP/halves.jnl" --journal "$TMP/halves.jnl" 200 < "$TMP/second.txt" > /dev/null 2>&1
+	if cmp -s "$TMP/once.jnl" "$TMP/again.jnl" && cmp -s "$TMP/once.jnl" "$TMP/halves.jnl"; then
+		pass "journal is deterministic"
+	else
+		fail "journal is deterministic"
+	fi
+}
+
+# Seeking with --from through the feed index skips out of order messages like a full replay does
+test_seek_skips_out_of_order() {
+	cp $FEEDS/out_of_order.txt "$TMP/out_of_order.txt" # the index is written next to the feed
+	$PRICER 200 "$TMP/out_of_order.txt" 2> /dev/null | awk '$1 >= 1006 && ($2 == "B" || $2 == "S")' > "$TMP/replayed.out"
+	$PRICER --from 1006 --index-interval 2 200 "$TMP/out_of_order.txt" 2> /dev/null | awk '$2 == "B" || $2 == "S"' > "$TMP/seeked.out"
+	if [ -s "$TMP/replayed.out" ] && cmp -s "$TMP/replayed.out" "$TMP/seeked.out"; then
+		pass "seek skips out of order messages"
+	else
+		fail "seek skips out of order messages"
+	fi
+}
+
+# A feed rewritten to the same size is not seeked with the index built for its old contents
+test_seek_rebuilds_stale_index() {
+	cp $FEEDS/mixed.txt "$TMP/rewritten.txt"
+	$PRICER --from 28803946 --index-interval 100 200 "$TMP/rewritten.txt" > /dev/null 2>&1
+	tr 'BS' 'SB' < $FEEDS/mixed.txt > "$TMP/swapped.txt"
+	cat "$TMP/swapped.txt" > "$TMP/rewritten.txt" # same size, new modification time
+	$PRICER --from 28803946 --index-interval 100 200 "$TMP/swapped.txt" 2> /dev/null > "$TMP/fresh.out"
+	$PRICER --from 28803946 --index-interval 100 200 "$TMP/rewritten.txt" 2> /dev/null > "$TMP/seeked.out"
+	if [ -s "$TMP/fresh.out" ] && cmp -s "$TMP/fresh.out" "$TMP/seeked.out"; then
+		pass "seek rebuilds a stale index"
+	else
+		fail "seek rebuilds a stale index"
+	fi
+}
+
+# The reference book agrees with the Pricer's book and displayed costs, message by message or conflated
+test_verify_agrees() {
+	$PRICER --verify 1 200 < $FEEDS/mixed.txt 2> "$TMP/verify.err" > /dev/null
+	$PRICER --verify 1 --conflate 200 < $FEEDS/mixed.txt 2>> "$TMP/verify.err" > /dev/null
+	if [ $(grep -c "costs against the reference book: no divergence" "$TMP/verify.err") -eq 2 ]; then
+		pass "verify agrees"
+	else
+		fail "verify agrees"
+	fi
+}
+
+# --batch and --multiplex price a gzipped feed the same as the plain one
+test_compressed_batch_and_multiplex() {
+	cp $FEEDS/mixed.txt "$TMP/mixed.txt"
+	gzip -c $FEEDS/mixed.txt > "$TMP/mixed.txt.gz"
+	for mode in --batch --multiplex; do
+		$PRICER $mode 200 "$TMP/mixed.txt" 2> /dev/null | sed 's|mixed\.txt|feed|' > "$TMP/plain.out"
+		$PRICER $mode 200 "$TMP/mixed.txt.gz" 2> /dev/null | sed 's|mixed\.txt\.gz|feed|' > "$TMP/gzip.out"
+		if [ $(grep -c " [BS] " "$TMP/plain.out") -gt 0 ] && cmp -s "$TMP/plain.out" "$TMP/gzip.out"; then
+			pass "$mode reads gzip"
+		else
+			fail "$mode reads gzip"
+		fi
+	done
+}
+
+# With a query server, a feed redirected from a regular file still ends the run
+test_query_exits_at_end_of_file() {
+	if timeout 10 $PRICER --query "$TMP/q.sock" 200 < $FEEDS/mixed.txt > /dev/null 2>&1; then
+		pass "query server exits at end of file"
+	else
+		fail "query server exits at end of file"
+	fi
+}
+
+# A message whose id is too long to journal is skipped like any bad message, and the run goes on
+test_journal_skips_long_ids() {
+	head -10 $FEEDS/mixed.txt > "$TMP/long_id.txt"
+	printf '28800014 A %s B 44.00 100\n' "$(head -c 70000 /dev/zero | tr '\0' x)" >> "$TMP/long_id.txt"
+	tail -n +11 $FEEDS/mixed.txt >> "$TMP/long_id.txt"
+	$PRICER --journal "$TMP/long_id.jnl" 200 < "$TMP/long_id.txt" > "$TMP/long_id.out" 2> "$TMP/long_id.err"
+	status=$?
+	$PRICER --journal "$TMP/short_id.jnl" 200 < $FEEDS/mixed.txt > "$TMP/short_id.out" 2> /dev/null
+	if [ $status -eq 0 ] && grep -q "badParse=1" "$TMP/long_id.err" && cmp -s "$TMP/long_id.out" "$TMP/short_id.out" &&
+			cmp -s "$TMP/long_id.jnl" "$TMP/short_id.jnl"; then
+		pass "journal skips long ids"
+	else
+		fail "journal skips long ids"
+	fi
+}
+
+test_journal_is_deterministic
+test_journal_skips_long_ids
+test_seek_skips_out_of_order
+test_seek_rebuilds_stale_index
+test_verify_agrees
+test_compressed_batch_and_multiplex
+test_query_exits_at_end_of_file
+
+if [ $failures -gt 0 ]; then
+	echo "$failures test(s) failed"
+	exit 1
+fi
+echo "All tests passed"